@@ -0,0 +1,84 @@
+#!/bin/sh
+#
+# Run cplanet update against a synthetic corpus served by benchd on the
+# loopback, on a scratch database, and report throughput and per-phase times.
+#
+# usage: bench.sh <cplanet> <benchd> <template>
+#
+# The corpus and the server are tuned from the environment:
+#	BENCH_FEEDS	number of feeds (50)
+#	BENCH_ENTRIES	entries per feed (20)
+#	BENCH_SIZE	average content size in bytes (2000)
+#	BENCH_RSS	percentage of RSS feeds, the others are Atom (50)
+#	BENCH_LATENCY	milliseconds before each answer (0)
+#	BENCH_FAILURES	percentage of requests answered with a 500 (0)
+#	BENCH_JOBS	outputs rendered at once, passed as update -j
+
+set -e
+
+if [ $# -ne 3 ]; then
+	echo "usage: bench.sh <cplanet> <benchd> <template>" >&2
+	exit 1
+fi
+
+CPLANET=$1
+BENCHD=$2
+TEMPLATE=$3
+FEEDS=${BENCH_FEEDS:-50}
+ENTRIES=${BENCH_ENTRIES:-20}
+
+tmp=$(mktemp -d "${TMPDIR:-/tmp}/cplanet-bench.XXXXXX")
+pid=
+cleanup() {
+	[ -n "$pid" ] && kill "$pid" 2>/dev/null
+	rm -rf "$tmp"
+}
+trap cleanup EXIT INT TERM
+
+# the configuration file is looked up in $HOME, keep it out of the way
+HOME=$tmp
+export HOME
+db=$tmp/cplanet.db
+mkdir -p "$tmp/out"
+
+"$BENCHD" -f "$FEEDS" -e "$ENTRIES" -s "${BENCH_SIZE:-2000}" \
+    -r "${BENCH_RSS:-50}" -l "${BENCH_LATENCY:-0}" \
+    -x "${BENCH_FAILURES:-0}" > "$tmp/benchd" &
+pid=$!
+while [ ! -s "$tmp/benchd" ]; do
+	kill -0 "$pid" 2>/dev/null || { echo "benchd failed" >&2; exit 1; }
+	sleep 0.1
+done
+read -r _ port _ _ _ _ _ bytes < "$tmp/benchd"
+
+i=0
+while [ "$i" -lt "$FEEDS" ]; do
+	"$CPLANET" -d "$db" feed "feed$i" "http://127.0.0.1:$port/feed/$i.xml" \
+	    "http://bench.invalid/$i"
+	i=$((i + 1))
+done
+"$CPLANET" -d "$db" output "$tmp/out/index.html" "$TEMPLATE"
+"$CPLANET" -d "$db" output "$tmp/out/index.atom" builtin:atom
+
+now() {
+	date +%s%N 2>/dev/null | sed 's/N$/000000000/'
+}
+
+run() {
+	start=$(now)
+	"$CPLANET" -v -d "$db" update ${BENCH_JOBS:+-j "$BENCH_JOBS"} \
+	    > "$tmp/log" 2>&1 || true
+	end=$(now)
+	ms=$(( (end - start) / 1000000 ))
+	[ "$ms" -gt 0 ] || ms=1
+	printf "%-6s %6d ms  %8d entries/s  %6d feeds/s  %6d KiB/s\n" "$1" "$ms" \
+	    $((FEEDS * ENTRIES * 1000 / ms)) $((FEEDS * 1000 / ms)) \
+	    $((bytes * 1000 / 1024 / ms))
+	grep "update: fetch" "$tmp/log" | sed 's/^[^:]*: /       /'
+}
+
+echo "corpus: $FEEDS feeds, $((FEEDS * ENTRIES)) entries, $bytes bytes," \
+    "latency ${BENCH_LATENCY:-0}ms, failures ${BENCH_FAILURES:-0}%"
+# the first run inserts everything, the second finds it all known already
+run cold
+run warm
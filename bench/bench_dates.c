@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2010, Baptiste Daroussin
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* date parsing of the feeds and date formatting of the dataset */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "micro.h"
+
+static const char *iso8601[] = {
+	"2024-01-02T10:00:00Z",
+	"2024-01-02T10:00:00+01:00",
+	"2024-01-02T10:00:00.123Z",
+	"2024-01-02T10:00:00-05:00",
+};
+
+static const char *rfc822[] = {
+	"Tue, 02 Jan 2024 10:00:00 +0000",
+	"Tue, 02 Jan 2024 10:00:00 GMT",
+	"Tue, 02 Jan 2024 10:00:00 -0500",
+	"Tue, 2 Jan 2024 10:00:00 +0000",
+};
+
+#define NDATES (sizeof(iso8601) / sizeof(iso8601[0]))
+
+int
+main(int argc, char **argv)
+{
+	struct timespec start;
+	volatile time_t sink = 0;
+	const char *format;
+	long i, n = 200000 * micro_scale(argc, argv);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < n; i++)
+		sink += iso8601_to_time_t(iso8601[i % NDATES]);
+	micro_report("iso8601_to_time_t", n, 0, elapsed_ms(&start));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < n; i++)
+		sink += rfc822_to_time_t(rfc822[i % NDATES]);
+	micro_report("rfc822_to_time_t", n, 0, elapsed_ms(&start));
+
+	format = "%d/%m/%Y";
+	/* posts are formatted newest first, a few of them each day */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < n; i++)
+		sink += post_dates(1700000000 - i * 3600, format)->rfc822[0];
+	micro_report("post_dates, one per hour", n, 0, elapsed_ms(&start));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < n; i++)
+		sink += post_dates(1700000000 - i * 86400 * 3, format)->rfc822[0];
+	micro_report("post_dates, one every 3 days", n, 0, elapsed_ms(&start));
+
+	format = "%d/%m/%Y %H:%M";
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < n; i++)
+		sink += post_dates(1700000000 - i * 3600, format)->rfc822[0];
+	micro_report("post_dates, format with time", n, 0, elapsed_ms(&start));
+
+	return (sink == 0);
+}
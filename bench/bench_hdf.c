@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2010, Baptiste Daroussin
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * the dataset of the outputs rendered with a template, and the two ways of
+ * filling its lists on the HDF library linked: formatting the full key of
+ * every field, or setting the fields on the node of each entry
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "micro.h"
+
+#define NFEEDS 20
+#define NENTRIES 50
+#define MAX_POST 200
+#define NPOSTS 5000
+
+static void
+build(const char *name, struct view *views, size_t nviews, long rounds)
+{
+	struct timespec start;
+	uint64_t h;
+	size_t i;
+	long r;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < nviews; i++) {
+			views[i].count = 0;
+			views[i].hash = 0;
+		}
+		if (dataset_build(views, nviews, &h) != 0)
+			errx(1, "dataset_build failed");
+	}
+	micro_report(name, rounds, 0, elapsed_ms(&start));
+}
+
+/* what cplanet did before the dataset builder, one formatted key per field */
+static void
+set_valuef(HDF *hdf)
+{
+	int i;
+
+	for (i = 0; i < NPOSTS; i++) {
+		cp_set_name(hdf, i, "feed");
+		cp_set_feedname(hdf, i, "Blog title");
+		cp_set_title(hdf, i, "Entry title");
+		cp_set_author(hdf, i, "Author");
+		cp_set_link(hdf, i, "http://bench.invalid/post");
+		cp_set_date(hdf, i, (long long)1700000000 + i);
+		cp_set_date_iso8601(hdf, i, "2023-11-14T22:13:20Z");
+		cp_set_date_rfc822(hdf, i, "Tue, 14 Nov 2023 22:13:20 +0000");
+		cp_set_formated_date(hdf, i, "14/11/2023");
+		cp_set_description(hdf, i, "<p>lorem ipsum</p>");
+	}
+}
+
+/* what dataset_build does, the node of the entry is looked up once */
+static void
+set_value(HDF *hdf)
+{
+	HDF *posts, *post;
+	NEOERR *neoerr;
+	char num[32];
+	int i;
+
+	if ((neoerr = hdf_get_node(hdf, "CPlanet.Posts", &posts)) != STATUS_OK)
+		errx(1, "hdf_get_node failed");
+	for (i = 0; i < NPOSTS; i++) {
+		snprintf(num, sizeof(num), "%d", i);
+		if ((neoerr = hdf_get_node(posts, num, &post)) != STATUS_OK)
+			errx(1, "hdf_get_node failed");
+		hdf_set_value(post, "Name", "feed");
+		hdf_set_value(post, "FeedName", "Blog title");
+		hdf_set_value(post, "Title", "Entry title");
+		hdf_set_value(post, "Author", "Author");
+		hdf_set_value(post, "Link", "http://bench.invalid/post");
+		snprintf(num, sizeof(num), "%lld", (long long)1700000000 + i);
+		hdf_set_value(post, "Date", num);
+		hdf_set_value(post, "DateISO8601", "2023-11-14T22:13:20Z");
+		hdf_set_value(post, "DateRFC822", "Tue, 14 Nov 2023 22:13:20 +0000");
+		hdf_set_value(post, "FormatedDate", "14/11/2023");
+		hdf_set_value(post, "Description", "<p>lorem ipsum</p>");
+	}
+}
+
+static void
+fill(const char *name, void (*set)(HDF *), long rounds)
+{
+	struct timespec start;
+	HDF *hdf;
+	long r;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < rounds; r++) {
+		if (hdf_init(&hdf) != STATUS_OK)
+			errx(1, "hdf_init failed");
+		set(hdf);
+		hdf_destroy(&hdf);
+	}
+	micro_report(name, rounds * NPOSTS, 0, elapsed_ms(&start));
+}
+
+int
+main(int argc, char **argv)
+{
+	struct view views[4];
+	struct feed_stats st;
+	char *body;
+	size_t len;
+	long rounds = 20 * micro_scale(argc, argv);
+	int i;
+
+	micro_db(MAX_POST);
+	memset(&st, 0, sizeof(st));
+	sql_exec("BEGIN;");
+	for (i = 0; i < NFEEDS; i++) {
+		body = micro_feed(i, NENTRIES, 2000, i % 2, &len);
+		parse_posts((const unsigned char *)"micro", body, len, "micro", &st);
+		free(body);
+	}
+	sql_exec("COMMIT;");
+
+	memset(views, 0, sizeof(views));
+	for (i = 0; i < 4; i++) {
+		views[i].rowid = i + 1;
+		views[i].filter.limit = cp->cfg.max_post;
+	}
+	build("dataset_build, 1 output", views, 1, rounds);
+	build("dataset_build, 4 outputs", views, 4, rounds);
+
+	/* a filtered output reads its own posts on the tags index */
+	views[2].filter.tag = "tag3";
+	build("dataset_build, filtered outputs", views, 4, rounds);
+	/* past the recent window the posts come from the whole archive */
+	views[3].filter.limit = NFEEDS * NENTRIES;
+	build("dataset_build, whole archive", views, 4, rounds);
+
+	fill("hdf_set_valuef, per post", set_valuef, rounds);
+	fill("hdf_set_value, per post", set_value, rounds);
+
+	micro_done();
+
+	return (0);
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2010, Baptiste Daroussin
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * feeds parsed from memory: the expat handlers, and the storage of the
+ * entries which is accounted apart
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "micro.h"
+
+#define NFEEDS 16
+#define NENTRIES 50
+
+static void
+parse_all(const char *name, char **bodies, size_t *lens, long rounds)
+{
+	struct feed_stats st;
+	struct timespec start;
+	size_t bytes = 0;
+	double ms;
+	long r;
+	int i;
+
+	memset(cp->phase_ms, 0, sizeof(cp->phase_ms));
+	memset(&st, 0, sizeof(st));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < rounds; r++) {
+		sql_exec("BEGIN;");
+		for (i = 0; i < NFEEDS; i++) {
+			parse_posts((const unsigned char *)(i % 2 ? "rss" : "atom"),
+			    bodies[i], lens[i], "micro", &st);
+			bytes += lens[i];
+		}
+		sql_exec("COMMIT;");
+	}
+	ms = elapsed_ms(&start);
+	micro_report(name, rounds * NFEEDS * NENTRIES, bytes, ms);
+	printf("%-32s parse %.3fms, db %.3fms, %lld inserted, %lld skipped\n", "",
+	    cp->phase_ms[PHASE_PARSE], cp->phase_ms[PHASE_DB], (long long)st.inserted,
+	    (long long)st.skipped);
+}
+
+int
+main(int argc, char **argv)
+{
+	char *bodies[NFEEDS];
+	size_t lens[NFEEDS];
+	long scale = micro_scale(argc, argv);
+	int i;
+
+	micro_db(NENTRIES);
+	for (i = 0; i < NFEEDS; i++)
+		bodies[i] = micro_feed(i, NENTRIES, 2000, i % 2, &lens[i]);
+
+	/* the first pass stores everything, the others find it unchanged */
+	parse_all("parse_posts, new entries", bodies, lens, 1);
+	parse_all("parse_posts, known entries", bodies, lens, 10 * scale);
+
+	for (i = 0; i < NFEEDS; i++)
+		free(bodies[i]);
+	micro_done();
+
+	return (0);
+}
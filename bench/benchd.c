@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2010, Baptiste Daroussin
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * benchd generates a synthetic corpus of Atom and RSS feeds and serves it on
+ * the loopback as /feed/<n>.xml, optionally slowed down and failing some
+ * requests, for cplanet update to be measured without the network.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "utstring.h"
+
+#define BASE_DATE 1700000000
+
+static const char *words[] = {
+	"lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing",
+	"elit", "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore",
+	"et", "dolore", "magna", "aliqua", "<b>enim</b>", "ad", "minim",
+	"veniam", "quis", "&amp;", "nostrud", "exercitation", "ullamco"
+};
+#define NWORDS (sizeof(words) / sizeof(words[0]))
+
+static UT_string **feeds;
+static long nfeeds = 50;
+static long latency = 0;	/* ms before each answer */
+static long failures = 0;	/* percent of the requests answered 500 */
+static uint64_t seed = 42;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t
+rnd(uint64_t *state)
+{
+	uint64_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*state = x;
+
+	return (x);
+}
+
+/* about size bytes of escaped html, give or take half of it */
+static void
+lorem(UT_string *out, uint64_t *state, long size)
+{
+	long len;
+	size_t start = utstring_len(out);
+
+	len = size / 2 + (long)(rnd(state) % (size + 1));
+	utstring_printf(out, "&lt;p&gt;");
+	while ((long)(utstring_len(out) - start) < len)
+		utstring_printf(out, "%s ", words[rnd(state) % NWORDS]);
+	utstring_printf(out, "&lt;/p&gt;");
+}
+
+static void
+feed_atom(UT_string *out, long n, long entries, long size, uint64_t *state)
+{
+	char date[32];
+	time_t t;
+	long e;
+
+	utstring_printf(out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	    "<feed xmlns=\"http://www.w3.org/2005/Atom\">\n"
+	    "<title>Bench feed %ld</title>\n", n);
+	for (e = 0; e < entries; e++) {
+		t = BASE_DATE - (e * nfeeds + n) * 600;
+		strftime(date, sizeof(date), "%FT%TZ", gmtime(&t));
+		utstring_printf(out, "<entry>\n<title>Entry %ld of feed %ld</title>\n"
+		    "<id>urn:bench:%ld:%ld</id>\n"
+		    "<link rel=\"alternate\" href=\"http://bench.invalid/%ld/%ld\"/>\n"
+		    "<published>%s</published>\n<updated>%s</updated>\n"
+		    "<author><name>Author %ld</name></author>\n"
+		    "<category term=\"tag%" PRIu64 "\"/>\n"
+		    "<content type=\"html\">", e, n, n, e, n, e, date, date, n,
+		    rnd(state) % 16);
+		lorem(out, state, size);
+		utstring_printf(out, "</content>\n</entry>\n");
+	}
+	utstring_printf(out, "</feed>\n");
+}
+
+static void
+feed_rss(UT_string *out, long n, long entries, long size, uint64_t *state)
+{
+	char date[64];
+	time_t t;
+	long e;
+
+	utstring_printf(out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	    "<rss version=\"2.0\">\n<channel>\n<title>Bench feed %ld</title>\n", n);
+	for (e = 0; e < entries; e++) {
+		t = BASE_DATE - (e * nfeeds + n) * 600;
+		strftime(date, sizeof(date), "%a, %d %b %Y %T +0000", gmtime(&t));
+		utstring_printf(out, "<item>\n<title>Entry %ld of feed %ld</title>\n"
+		    "<guid>urn:bench:%ld:%ld</guid>\n"
+		    "<link>http://bench.invalid/%ld/%ld</link>\n"
+		    "<pubDate>%s</pubDate>\n"
+		    "<category>tag%" PRIu64 "</category>\n"
+		    "<description>", e, n, n, e, n, e, date, rnd(state) % 16);
+		lorem(out, state, size);
+		utstring_printf(out, "</description>\n</item>\n");
+	}
+	utstring_printf(out, "</channel>\n</rss>\n");
+}
+
+static void
+reply(int fd, const char *status, const char *body, size_t len)
+{
+	char head[256];
+	ssize_t w;
+	int hlen;
+
+	hlen = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\n"
+	    "Content-Type: application/xml\r\nContent-Length: %zu\r\n"
+	    "Connection: close\r\n\r\n", status, len);
+	if (write(fd, head, hlen) != hlen)
+		return;
+	while (len > 0 && (w = write(fd, body, len)) > 0) {
+		body += w;
+		len -= w;
+	}
+}
+
+static void *
+serve(void *arg)
+{
+	struct timespec delay;
+	char req[4096];
+	size_t len = 0;
+	ssize_t r;
+	long n;
+	bool fail;
+	int fd = (int)(intptr_t)arg;
+
+	while (len < sizeof(req) - 1 &&
+	    (r = read(fd, req + len, sizeof(req) - 1 - len)) > 0) {
+		len += r;
+		req[len] = '\0';
+		if (strstr(req, "\r\n\r\n") != NULL)
+			break;
+	}
+	req[len] = '\0';
+
+	pthread_mutex_lock(&lock);
+	fail = failures > 0 && (long)(rnd(&seed) % 100) < failures;
+	pthread_mutex_unlock(&lock);
+
+	if (latency > 0) {
+		delay.tv_sec = latency / 1000;
+		delay.tv_nsec = (latency % 1000) * 1000000;
+		nanosleep(&delay, NULL);
+	}
+
+	if (sscanf(req, "GET /feed/%ld.xml ", &n) != 1 || n < 0 || n >= nfeeds)
+		reply(fd, "404 Not Found", "", 0);
+	else if (fail)
+		reply(fd, "500 Internal Server Error", "", 0);
+	else
+		reply(fd, "200 OK", utstring_body(feeds[n]),
+		    utstring_len(feeds[n]));
+	close(fd);
+
+	return (NULL);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: benchd [-f feeds] [-e entries] [-s size] "
+	    "[-r rss%%] [-l latency_ms] [-x failure%%] [-S seed] [-p port]\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct sockaddr_in sin;
+	socklen_t slen = sizeof(sin);
+	pthread_t thread;
+	uint64_t state;
+	long entries = 20, size = 2000, rss = 50, port = 0, n;
+	size_t bytes = 0;
+	int ch, s, fd, on = 1;
+
+	while ((ch = getopt(argc, argv, "e:f:l:p:r:s:S:x:")) != -1) {
+		switch (ch) {
+		case 'e':
+			entries = strtol(optarg, NULL, 10);
+			break;
+		case 'f':
+			nfeeds = strtol(optarg, NULL, 10);
+			break;
+		case 'l':
+			latency = strtol(optarg, NULL, 10);
+			break;
+		case 'p':
+			port = strtol(optarg, NULL, 10);
+			break;
+		case 'r':
+			rss = strtol(optarg, NULL, 10);
+			break;
+		case 's':
+			size = strtol(optarg, NULL, 10);
+			break;
+		case 'S':
+			seed = strtoull(optarg, NULL, 10);
+			break;
+		case 'x':
+			failures = strtol(optarg, NULL, 10);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (nfeeds <= 0 || entries < 0 || size < 0 || seed == 0)
+		usage();
+
+	if ((feeds = calloc(nfeeds, sizeof(UT_string *))) == NULL)
+		err(1, "calloc");
+	state = seed;
+	for (n = 0; n < nfeeds; n++) {
+		utstring_new(feeds[n]);
+		if ((long)(rnd(&state) % 100) < rss)
+			feed_rss(feeds[n], n, entries, size, &state);
+		else
+			feed_atom(feeds[n], n, entries, size, &state);
+		bytes += utstring_len(feeds[n]);
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	if ((s = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+		err(1, "socket");
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sin.sin_port = htons(port);
+	if (bind(s, (struct sockaddr *)&sin, sizeof(sin)) == -1)
+		err(1, "bind");
+	if (listen(s, 128) == -1)
+		err(1, "listen");
+	if (getsockname(s, (struct sockaddr *)&sin, &slen) == -1)
+		err(1, "getsockname");
+
+	/* the harness reads where to connect and what is served */
+	printf("port %d feeds %ld entries %ld bytes %zu\n", ntohs(sin.sin_port),
+	    nfeeds, nfeeds * entries, bytes);
+	fflush(stdout);
+
+	for (;;) {
+		if ((fd = accept(s, NULL, NULL)) == -1) {
+			if (errno == EINTR)
+				continue;
+			err(1, "accept");
+		}
+		if (pthread_create(&thread, NULL, serve, (void *)(intptr_t)fd) != 0) {
+			warnx("pthread_create failed");
+			close(fd);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+}
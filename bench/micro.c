@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2010, Baptiste Daroussin
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <err.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "micro.h"
+
+static struct cplanet *planet;
+
+/* the iterations are scaled by the first argument, 1 by default */
+long
+micro_scale(int argc, char **argv)
+{
+	long scale;
+
+	if (argc < 2)
+		return (1);
+	if ((scale = strtol(argv[1], NULL, 10)) < 1)
+		errx(1, "usage: %s [scale]", argv[0]);
+
+	return (scale);
+}
+
+/* n operations handling bytes of input took ms */
+void
+micro_report(const char *name, long n, size_t bytes, double ms)
+{
+	printf("%-32s %9ld ops %12.1f ns/op", name, n, ms * 1000000.0 / n);
+	if (bytes > 0 && ms > 0)
+		printf(" %9.1f MB/s", bytes / 1048.576 / ms);
+	printf("\n");
+}
+
+/*
+ * a scratch in-memory database, as cplanet -m would have it, with
+ * max_post posts kept in the recent window
+ */
+void
+micro_db(int64_t max_post)
+{
+	if (cplanet_init(0) != CPLANET_OK ||
+	    cplanet_open("micro.db", CPLANET_INMEMORY, &planet) != CPLANET_OK ||
+	    sql_exec("REPLACE INTO config VALUES ('max_post', %lld);",
+	    (long long)max_post) != 0 || cplanet_reload(planet) != CPLANET_OK)
+		errx(1, "Unable to set up the database: %s",
+		    cplanet_errmsg(planet));
+}
+
+/* the scratch database is thrown away */
+void
+micro_done(void)
+{
+	cplanet_close(planet);
+	cplanet_shutdown();
+}
+
+/* entries of an Atom or RSS feed, count entries of about size bytes */
+char *
+micro_feed(int n, int count, size_t size, bool rss, size_t *len)
+{
+	FILE *f;
+	char *buf = NULL, date[64];
+	time_t t;
+	size_t i;
+	int e;
+
+	if ((f = open_memstream(&buf, len)) == NULL)
+		err(1, "open_memstream");
+
+	if (rss)
+		fprintf(f, "<?xml version=\"1.0\"?>\n<rss version=\"2.0\"><channel>"
+		    "<title>Feed %d</title>\n", n);
+	else
+		fprintf(f, "<?xml version=\"1.0\"?>\n"
+		    "<feed xmlns=\"http://www.w3.org/2005/Atom\">"
+		    "<title>Feed %d</title>\n", n);
+	for (e = 0; e < count; e++) {
+		t = 1700000000 - (time_t)(e * 97 + n) * 600;
+		if (rss) {
+			strftime(date, sizeof(date), "%a, %d %b %Y %T +0000", gmtime(&t));
+			fprintf(f, "<item><title>Entry %d.%d</title>"
+			    "<guid>urn:micro:%d:%d</guid>"
+			    "<link>http://micro.invalid/%d/%d</link>"
+			    "<pubDate>%s</pubDate><category>tag%d</category>"
+			    "<description>", n, e, n, e, n, e, date, e % 8);
+		} else {
+			strftime(date, sizeof(date), "%FT%TZ", gmtime(&t));
+			fprintf(f, "<entry><title>Entry %d.%d</title>"
+			    "<id>urn:micro:%d:%d</id>"
+			    "<link rel=\"alternate\" href=\"http://micro.invalid/%d/%d\"/>"
+			    "<published>%s</published><updated>%s</updated>"
+			    "<author><name>Author %d</name></author>"
+			    "<category term=\"tag%d\"/><content type=\"html\">",
+			    n, e, n, e, n, e, date, date, n, e % 8);
+		}
+		fprintf(f, "&lt;p&gt;");
+		for (i = 0; i < size; i += 12)
+			fprintf(f, "lorem %05d ", (int)(i + e) % 100000);
+		fprintf(f, "&lt;/p&gt;%s\n", rss ? "</description></item>" :
+		    "</content></entry>");
+	}
+	fprintf(f, rss ? "</channel></rss>\n" : "</feed>\n");
+	fclose(f);
+
+	return (buf);
+}
@@ -0,0 +1,4990 @@
+/*
+ * Copyright (c) 2010, Baptiste Daroussin
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* vim:set ts=4 sw=4 sts=4: */
+
+#include <sys/param.h>
+#include <sys/resource.h>
+
+#include <assert.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <sqlite3.h>
+#include <expat.h>
+#include <curl/curl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <strings.h>
+#include <zlib.h>
+
+/* the utstring and utarray buffers go through the accounting of -M */
+static void *buf_malloc(size_t size);
+static void *buf_realloc(void *ptr, size_t size);
+static void buf_free(void *ptr);
+#define ut_malloc(sz) buf_malloc(sz)
+#define ut_realloc(ptr, sz) buf_realloc(ptr, sz)
+#define ut_free(ptr) buf_free(ptr)
+
+#include "utstring.h"
+#include "utarray.h"
+#include "cplanet.h"
+#include "core.h"
+
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+typedef enum {
+	NONE,
+	RSS,
+	ATOM,
+	UNKNOWN
+} feed_type;
+
+_Thread_local struct cplanet *cp = NULL;
+
+/* statements prepared once per planet, keyed by their sql */
+struct stmt_cache {
+	const char *sql;
+	sqlite3_stmt *stmt;
+	struct stmt_cache *next;
+};
+
+/*
+ * templates parsed once per dataset they render and per change of the
+ * file, a CSPARSE being bound to the dataset it was created on
+ */
+struct template {
+	char *path;
+	HDF *hdf;
+	time_t mtime;
+	CSPARSE *parse;
+	struct template *next;
+};
+
+const struct sibling_kind sibling_kinds[SIBLING_MAX] = {
+	{ "gzip", ".gz", 1, 9, 9, true },
+#ifdef HAVE_BROTLI
+	{ "brotli", ".br", 1, BROTLI_MAX_QUALITY, BROTLI_MAX_QUALITY, true },
+#else
+	{ "brotli", ".br", 1, 11, 11, false },
+#endif
+#ifdef HAVE_ZSTD
+	{ "zstd", ".zst", 1, 19, 19, true },
+#else
+	{ "zstd", ".zst", 1, 19, 19, false },
+#endif
+};
+
+/* a file to render, the result is read back once all are done */
+struct render {
+	char *path;
+	char *template;
+	HDF *hdf;
+	int64_t levels[SIBLING_MAX];	/* 0 when not wanted */
+	bool minify;
+	int64_t rowid;		/* output */
+	int64_t fingerprint;
+	int64_t index;		/* archive page: archive_index row */
+	int64_t since;		/* and date of its oldest post */
+	const struct out_format *format;	/* built-in output */
+	struct filter filter;
+	int ret;
+};
+
+/* outputs of the current update, consumed by the workers */
+struct renderq {
+	struct render *r;
+	size_t len;
+	size_t next;
+	pthread_mutex_t lock;
+};
+
+/*
+ * render threads, each one owns its parsed templates as a CSPARSE can not
+ * be rendered by two threads at once
+ */
+struct worker {
+	pthread_t thread;
+	struct cplanet *planet;
+	struct template *templates;
+	HDF *archive;		/* the archive pages are copied in, in turn */
+};
+#define RENDER_BATCH 64 /* archive pages built before rendering them */
+
+struct feed {
+	const unsigned char *name;
+	UT_string *blog_title;
+	UT_string *author;
+	bool has_author;
+	UT_string *data;
+	UT_string *uid;
+	UT_string *link;
+	UT_string *content;
+	UT_string *description;
+	int64_t compression;
+	uint64_t hash;
+	int64_t home_key;	/* link_key of the home of the feed */
+	sqlite3_stmt *stmt;
+	sqlite3_stmt *tags;
+	sqlite3_stmt *lookup;
+	sqlite3_stmt *fts_delete;
+	sqlite3_stmt *fts_insert;
+	sqlite3_stmt *recent_delete;
+	sqlite3_stmt *recent_insert;
+	sqlite3_stmt *recent_trim;
+	sqlite3_stmt *dup_lookup;
+	sqlite3_stmt *dup_insert;
+	sqlite3_stmt *post_delete;
+	sqlite3_stmt *post_touch;
+	sqlite3_stmt *archive_touch;
+	UT_array *tag;
+	struct buffer *xmlpath;
+	feed_type type;
+	struct feed_stats *stats;
+};
+
+struct buffer {
+	char *data;
+	size_t size;
+	size_t cap;
+};
+
+/*
+ * Compressed bodies are stored as blobs: the size of the inflated text as a
+ * 32 bits big endian integer followed by the zlib stream
+ */
+#define BODY_HDRLEN 4
+#define BODY_MINLEN 128
+
+/*
+ * The recent table is the window of the max_post newest posts, maintained
+ * while ingesting so that rendering does not depend on the size of the
+ * archive
+ */
+#define RECENT_SELECT "(post, date) SELECT rowid, date FROM posts "
+#define RECENT_POSTS "SELECT name, blog_title, title, author, link, " \
+	"recent.date, description, content, uid FROM recent " \
+	"JOIN posts ON posts.rowid=recent.post ORDER BY recent.date DESC, uid DESC;"
+#define POST_TAGS "SELECT tag FROM tags WHERE uid=?1;"
+#define MAX_POST ":max_post"
+/* the posts at the date of the oldest one are ordered as RECENT_POSTS does */
+#define RECENT_TRIM "DELETE FROM recent WHERE post IN (SELECT post FROM recent " \
+	"JOIN posts ON posts.rowid=recent.post " \
+	"ORDER BY recent.date DESC, uid DESC LIMIT -1 OFFSET " MAX_POST ");"
+
+/*
+ * seq numbers the changes to the posts: a post is given the next one when
+ * stored, replaced or given new tags, so that exporting what changed since
+ * a cursor is a range of the posts_seq index. The writers are serialised by
+ * sqlite and an update commits at once, so a reader never sees a number
+ * handed out before one it already saw. seq_removed keeps the highest
+ * number of the posts removed as duplicates so that it is not given again.
+ */
+#define NEXT_SEQ "(SELECT max(coalesce(max(seq), 0), " \
+	"(SELECT seq FROM seq_removed)) + 1 FROM posts)"
+#define EXPORT_POSTS "SELECT seq, uid, name, blog_title, title, author, " \
+	"link, date, updated, content, description FROM posts " \
+	"WHERE seq > ?1 ORDER BY seq LIMIT ?2;"
+
+/*
+ * Archives are paginated lists of all the posts, of the posts of each feed
+ * or of each tag. Pages are numbered from the oldest post so that a new post
+ * only changes the last pages. archive_index holds the number of pages of
+ * each list and the date from which its pages have to be rendered again.
+ */
+#define ARCHIVE_KEYS "SELECT 'page' AS kind, '' AS key, date FROM posts " \
+	"WHERE uid=?1 UNION ALL " \
+	"SELECT 'feed', name, date FROM posts WHERE uid=?1 UNION ALL " \
+	"SELECT 'tag', tag, date FROM posts JOIN tags USING (uid) " \
+	"WHERE posts.uid=?1"
+#define ARCHIVE_TOUCH "INSERT INTO archive_index (archive, key, dirty) " \
+	"SELECT archive.rowid, k.key, k.date FROM archive " \
+	"JOIN (" ARCHIVE_KEYS ") AS k ON k.kind=archive.kind WHERE true " \
+	"ON CONFLICT (archive, key) DO UPDATE SET " \
+	"dirty=min(coalesce(dirty, excluded.dirty), excluded.dirty);"
+#define ARCHIVE_TOUCH_ALL "INSERT INTO archive_index (archive, key, dirty) " \
+	"SELECT archive.rowid, k.key, (SELECT min(date) FROM posts) " \
+	"FROM archive JOIN (SELECT 'page' AS kind, '' AS key UNION ALL " \
+	"SELECT DISTINCT 'feed', name FROM posts UNION ALL " \
+	"SELECT DISTINCT 'tag', tag FROM tags) AS k ON k.kind=archive.kind " \
+	"WHERE archive.rowid=?1 " \
+	"ON CONFLICT (archive, key) DO UPDATE SET dirty=excluded.dirty;"
+#define ARCHIVE_SELECT "SELECT name, blog_title, title, author, link, date, " \
+	"description, content, uid FROM posts "
+#define ARCHIVE_COUNT "SELECT count(*), " \
+	"count(CASE WHEN date < ?2 THEN 1 END) FROM posts "
+#define ARCHIVE_PAGE "ORDER BY date DESC, uid DESC LIMIT ?2 OFFSET ?3;"
+
+#define ALL_POSTS ARCHIVE_SELECT "ORDER BY date DESC, uid DESC;"
+
+/*
+ * the posts outputs select by feed ?1 and tag ?2, at most ?3: a query for
+ * each kind of filter, reading the posts_name or tags_tag index
+ */
+#define FILTER_ORDER "ORDER BY date DESC, uid DESC LIMIT ?3;"
+#define FILTER_TAG "uid IN (SELECT uid FROM tags WHERE tag=?2) "
+static const char *filter_posts[] = {
+	ARCHIVE_SELECT FILTER_ORDER,
+	ARCHIVE_SELECT "WHERE name=?1 " FILTER_ORDER,
+	ARCHIVE_SELECT "WHERE " FILTER_TAG FILTER_ORDER,
+	ARCHIVE_SELECT "WHERE name=?1 AND " FILTER_TAG FILTER_ORDER,
+};
+
+const struct archive_kind archive_kinds[] = {
+	{ "page",
+	  ARCHIVE_COUNT "WHERE ?1 = '';",
+	  ARCHIVE_SELECT "WHERE ?1 = '' " ARCHIVE_PAGE },
+	{ "feed",
+	  ARCHIVE_COUNT "WHERE name=?1;",
+	  ARCHIVE_SELECT "WHERE name=?1 " ARCHIVE_PAGE },
+	{ "tag",
+	  ARCHIVE_COUNT "WHERE uid IN (SELECT uid FROM tags WHERE tag=?1);",
+	  ARCHIVE_SELECT "WHERE uid IN (SELECT uid FROM tags WHERE tag=?1) "
+	  ARCHIVE_PAGE },
+};
+
+const unsigned int archive_kinds_len = sizeof(archive_kinds) / sizeof(archive_kinds[0]);
+
+/* shorter texts are too likely to be the same by chance to be duplicates */
+#define DEDUP_MINLEN 200
+
+#define DB_BUSY_TIMEOUT 30000	/* ms an update may hold the database */
+
+/*
+ * warn(3) kept as the last error of the planet, and printed unless it is
+ * quiet; the render threads use it too, their lines are not mixed
+ */
+static void
+cp_vwarn(bool errnum, const char *fmt, va_list ap)
+{
+	char msg[sizeof(cp->errmsg)];
+	int saved = errno;
+
+	vsnprintf(msg, sizeof(msg), fmt, ap);
+	if (errnum)
+		snprintf(msg + strlen(msg), sizeof(msg) - strlen(msg), ": %s",
+		    strerror(saved));
+	if (cp != NULL) {
+		pthread_mutex_lock(&cp->lock);
+		memcpy(cp->errmsg, msg, sizeof(msg));
+		pthread_mutex_unlock(&cp->lock);
+		if (cp->quiet)
+			return;
+	}
+	flockfile(stderr);
+	warnx("%s", msg);
+	funlockfile(stderr);
+}
+
+static void
+cp_warn(bool errnum, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	cp_vwarn(errnum, fmt, ap);
+	va_end(ap);
+}
+
+/* what is reported with CPLANET_VERBOSE, not an error */
+static void
+cp_info(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	flockfile(stderr);
+	vwarnx(fmt, ap);
+	funlockfile(stderr);
+	va_end(ap);
+}
+
+/*
+ * Memory accounting of -M: sqlite, expat, curl and the utstring/utarray
+ * buffers get counting allocators, each block being prefixed with its size.
+ * The peaks are kept for each subsystem, the last one being their total,
+ * overall and during each phase of the update. ClearSilver can not be given
+ * an allocator, what it uses only shows in the peak RSS.
+ */
+enum {
+	MEM_SQLITE,
+	MEM_EXPAT,
+	MEM_CURL,
+	MEM_BUFFERS,
+	MEM_TOTAL,
+	MEM_MAX
+};
+
+static const char *mem_names[MEM_MAX] = {
+	"sqlite", "expat", "curl", "buffers", "total"
+};
+
+static const char *phase_names[PHASE_MAX] = {
+	"fetch", "parse", "db", "hdf", "render", "archive"
+};
+
+static struct {
+	int64_t current;
+	int64_t peak;
+	int64_t phase[PHASE_MAX];	/* peak during each phase */
+} mem[MEM_MAX];
+static bool mem_counting = false;
+static int mem_phase = PHASE_FETCH;	/* blurred by planets updating at once */
+
+#define MEM_HDRLEN 16	/* keeps the blocks aligned as malloc(3) does */
+
+static void
+mem_peak(int64_t *peak, int64_t value)
+{
+	int64_t old = __atomic_load_n(peak, __ATOMIC_RELAXED);
+
+	while (value > old && !__atomic_compare_exchange_n(peak, &old, value,
+	    true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+static void
+mem_add(int kind, int64_t delta)
+{
+	int64_t cur;
+	int phase;
+
+	cur = __atomic_add_fetch(&mem[kind].current, delta, __ATOMIC_RELAXED);
+	if (delta > 0) {
+		phase = __atomic_load_n(&mem_phase, __ATOMIC_RELAXED);
+		mem_peak(&mem[kind].peak, cur);
+		mem_peak(&mem[kind].phase[phase], cur);
+	}
+}
+
+static void
+mem_count(int kind, int64_t delta)
+{
+	mem_add(kind, delta);
+	mem_add(MEM_TOTAL, delta);
+}
+
+/* what is held when a phase starts counts in its peak */
+static void
+phase_enter(int phase)
+{
+	int i;
+
+	__atomic_store_n(&mem_phase, phase, __ATOMIC_RELAXED);
+	if (!mem_counting)
+		return;
+	for (i = 0; i < MEM_MAX; i++)
+		mem_peak(&mem[i].phase[phase],
+		    __atomic_load_n(&mem[i].current, __ATOMIC_RELAXED));
+}
+
+static void *
+mem_malloc(int kind, size_t size)
+{
+	char *p;
+
+	if ((p = malloc(size + MEM_HDRLEN)) == NULL)
+		return (NULL);
+	*(size_t *)p = size;
+	mem_count(kind, size);
+
+	return (p + MEM_HDRLEN);
+}
+
+static void
+mem_free(int kind, void *ptr)
+{
+	char *p = ptr;
+
+	if (p == NULL)
+		return;
+	p -= MEM_HDRLEN;
+	mem_count(kind, -(int64_t)*(size_t *)p);
+	free(p);
+}
+
+static void *
+mem_realloc(int kind, void *ptr, size_t size)
+{
+	char *p = ptr;
+	size_t old;
+
+	if (p == NULL)
+		return (mem_malloc(kind, size));
+	p -= MEM_HDRLEN;
+	old = *(size_t *)p;
+	if ((p = realloc(p, size + MEM_HDRLEN)) == NULL)
+		return (NULL);
+	*(size_t *)p = size;
+	mem_count(kind, (int64_t)size - (int64_t)old);
+
+	return (p + MEM_HDRLEN);
+}
+
+static size_t
+mem_size(void *ptr)
+{
+	return (ptr == NULL ? 0 : *(size_t *)((char *)ptr - MEM_HDRLEN));
+}
+
+static void *
+buf_malloc(size_t size)
+{
+	return (mem_counting ? mem_malloc(MEM_BUFFERS, size) : malloc(size));
+}
+
+static void *
+buf_realloc(void *ptr, size_t size)
+{
+	return (mem_counting ? mem_realloc(MEM_BUFFERS, ptr, size) :
+	    realloc(ptr, size));
+}
+
+static void
+buf_free(void *ptr)
+{
+	if (mem_counting)
+		mem_free(MEM_BUFFERS, ptr);
+	else
+		free(ptr);
+}
+
+static void *
+sqlite_malloc(int size)
+{
+	return (mem_malloc(MEM_SQLITE, size));
+}
+
+static void
+sqlite_free(void *ptr)
+{
+	mem_free(MEM_SQLITE, ptr);
+}
+
+static void *
+sqlite_realloc(void *ptr, int size)
+{
+	return (mem_realloc(MEM_SQLITE, ptr, size));
+}
+
+static int
+sqlite_size(void *ptr)
+{
+	return ((int)mem_size(ptr));
+}
+
+static int
+sqlite_roundup(int size)
+{
+	return ((size + 7) & ~7);
+}
+
+static int
+sqlite_init(void *data)
+{
+	return (SQLITE_OK);
+}
+
+static void
+sqlite_shutdown(void *data)
+{
+}
+
+static void *
+expat_malloc(size_t size)
+{
+	return (mem_malloc(MEM_EXPAT, size));
+}
+
+static void *
+expat_realloc(void *ptr, size_t size)
+{
+	return (mem_realloc(MEM_EXPAT, ptr, size));
+}
+
+static void
+expat_free(void *ptr)
+{
+	mem_free(MEM_EXPAT, ptr);
+}
+
+static const XML_Memory_Handling_Suite expat_mem = {
+	expat_malloc, expat_realloc, expat_free
+};
+
+static void *
+curlmem_malloc(size_t size)
+{
+	return (mem_malloc(MEM_CURL, size));
+}
+
+static void
+curlmem_free(void *ptr)
+{
+	mem_free(MEM_CURL, ptr);
+}
+
+static void *
+curlmem_realloc(void *ptr, size_t size)
+{
+	return (mem_realloc(MEM_CURL, ptr, size));
+}
+
+static char *
+curlmem_strdup(const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *p;
+
+	if ((p = mem_malloc(MEM_CURL, len)) != NULL)
+		memcpy(p, str, len);
+
+	return (p);
+}
+
+static void *
+curlmem_calloc(size_t nmemb, size_t size)
+{
+	void *p;
+
+	if (size != 0 && nmemb > SIZE_MAX / size)
+		return (NULL);
+	if ((p = mem_malloc(MEM_CURL, nmemb * size)) != NULL)
+		memset(p, 0, nmemb * size);
+
+	return (p);
+}
+
+/*
+ * install the counting allocators, before sqlite is initialised and before
+ * anything is allocated through them
+ */
+static void
+mem_init(void)
+{
+	static const sqlite3_mem_methods sqlite_mem = {
+		sqlite_malloc, sqlite_free, sqlite_realloc, sqlite_size,
+		sqlite_roundup, sqlite_init, sqlite_shutdown, NULL
+	};
+
+	if (sqlite3_config(SQLITE_CONFIG_MALLOC, &sqlite_mem) != SQLITE_OK)
+		warnx("Unable to account the memory used by sqlite");
+	mem_counting = true;
+}
+
+/* what is still allocated, the peaks, and the peak RSS of the process */
+static void
+mem_report(void)
+{
+	struct rusage ru;
+	int i, p;
+
+	if (!mem_counting)
+		return;
+
+	fprintf(stderr, "%-10s%12s%12s", "memory", "current", "peak");
+	for (p = 0; p < PHASE_MAX; p++)
+		fprintf(stderr, "%12s", phase_names[p]);
+	fprintf(stderr, "\n");
+	for (i = 0; i < MEM_MAX; i++) {
+		fprintf(stderr, "%-10s%12lld%12lld", mem_names[i],
+		    (long long)mem[i].current, (long long)mem[i].peak);
+		for (p = 0; p < PHASE_MAX; p++)
+			fprintf(stderr, "%12lld", (long long)mem[i].phase[p]);
+		fprintf(stderr, "\n");
+	}
+	if (getrusage(RUSAGE_SELF, &ru) == 0)
+		fprintf(stderr, "peak rss: %ld KiB\n", ru.ru_maxrss);
+}
+
+/*
+ * Chrome trace events of the updates of a planet, cp->trace is NULL
+ * otherwise and the spans are neither timed nor written
+ */
+struct trace {
+	FILE *f;
+	struct timespec origin;
+	size_t events;
+	pthread_mutex_t lock;
+};
+static _Thread_local int trace_tid = 0;	/* 0 for the main thread, then the workers */
+
+#define TRACE_START(ts) do { \
+	if (cp->trace != NULL) \
+		clock_gettime(CLOCK_MONOTONIC, (ts)); \
+} while (0)
+#define TRACE_SPAN(...) do { \
+	if (cp->trace != NULL) \
+		trace_span(__VA_ARGS__); \
+} while (0)
+
+double
+elapsed_ms(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((now.tv_sec - start->tv_sec) * 1000.0 +
+	    (now.tv_nsec - start->tv_nsec) / 1000000.0);
+}
+
+static double
+trace_us(const struct timespec *ts)
+{
+	return ((ts->tv_sec - cp->trace->origin.tv_sec) * 1000000.0 +
+	    (ts->tv_nsec - cp->trace->origin.tv_nsec) / 1000.0);
+}
+
+static void
+trace_str(FILE *f, const char *s)
+{
+	fputc('"', f);
+	for (; *s != '\0'; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(f, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			fprintf(f, "\\u%04x", *s);
+		else
+			fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+static void
+trace_thread_name(struct trace *t, int tid, const char *name)
+{
+	fprintf(t->f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+	    "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+	    t->events++ > 0 ? ",\n" : "", tid, name);
+}
+
+/* start a trace in path, with a track for each of the render threads */
+static bool
+trace_open(const char *path)
+{
+	struct trace *t;
+	char name[32];
+	long i;
+
+	if ((t = calloc(1, sizeof(struct trace))) == NULL) {
+		cp_warn(true, "calloc");
+		return (false);
+	}
+	if ((t->f = fopen(path, "w")) == NULL) {
+		cp_warn(true, "%s", path);
+		free(t);
+		return (false);
+	}
+	pthread_mutex_init(&t->lock, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t->origin);
+	fprintf(t->f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	trace_thread_name(t, 0, "main");
+	for (i = 0; i < cp->njobs; i++) {
+		snprintf(name, sizeof(name), "render %ld", i + 1);
+		trace_thread_name(t, i + 1, name);
+	}
+	cp->trace = t;
+
+	return (true);
+}
+
+static int
+trace_close(void)
+{
+	struct trace *t = cp->trace;
+	int ret = 0;
+
+	if (t == NULL)
+		return (0);
+	fprintf(t->f, "\n]}\n");
+	if (fclose(t->f) != 0) {
+		cp_warn(true, "trace");
+		ret = -1;
+	}
+	pthread_mutex_destroy(&t->lock);
+	free(t);
+	cp->trace = NULL;
+
+	return (ret);
+}
+
+/*
+ * a span from start to now on the track of the calling thread, with the
+ * key=value argument and the bytes handled when not NULL and not negative
+ */
+static void
+trace_span(const char *cat, const char *name, const struct timespec *start,
+    const char *key, const char *value, int64_t bytes)
+{
+	struct trace *t = cp->trace;
+	struct timespec now;
+	double ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ts = trace_us(start);
+
+	pthread_mutex_lock(&t->lock);
+	fprintf(t->f, "%s{\"name\":", t->events++ > 0 ? ",\n" : "");
+	trace_str(t->f, name);
+	fprintf(t->f, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+	    "\"ts\":%.3f,\"dur\":%.3f,\"args\":{", cat, trace_tid, ts,
+	    trace_us(&now) - ts);
+	if (value != NULL) {
+		fprintf(t->f, "\"%s\":", key);
+		trace_str(t->f, value);
+	}
+	if (bytes >= 0)
+		fprintf(t->f, "%s\"bytes\":%lld", value != NULL ? "," : "",
+		    (long long)bytes);
+	fprintf(t->f, "}}");
+	pthread_mutex_unlock(&t->lock);
+}
+
+/*
+ * return the prepared statement for sql, reset and with its bindings
+ * cleared. sql is expected to be a string constant, the statement stays
+ * owned by the cache
+ */
+static sqlite3_stmt *
+sql_prepare(const char *sql)
+{
+	struct stmt_cache *c;
+
+	for (c = cp->stmts; c != NULL; c = c->next) {
+		if (c->sql == sql || !strcmp(c->sql, sql)) {
+			sqlite3_reset(c->stmt);
+			sqlite3_clear_bindings(c->stmt);
+			return (c->stmt);
+		}
+	}
+
+	if ((c = malloc(sizeof(struct stmt_cache))) == NULL) {
+		cp_warn(true, "malloc");
+		return (NULL);
+	}
+
+	if (sqlite3_prepare_v2(cp->db, sql, -1, &c->stmt, NULL) != SQLITE_OK) {
+		cp_warn(false, "sqlite: %s (%s)", sqlite3_errmsg(cp->db), sql);
+		free(c);
+		return (NULL);
+	}
+	c->sql = sql;
+	c->next = cp->stmts;
+	cp->stmts = c;
+
+	return (c->stmt);
+}
+
+static void
+sql_cache_free(void)
+{
+	struct stmt_cache *c;
+
+	while ((c = cp->stmts) != NULL) {
+		cp->stmts = c->next;
+		sqlite3_finalize(c->stmt);
+		free(c);
+	}
+}
+
+/* bind the config values a statement refers to as :key */
+static void
+sql_bind_config(sqlite3_stmt *stmt)
+{
+	int i;
+
+	if ((i = sqlite3_bind_parameter_index(stmt, ":date_format")) != 0)
+		sqlite3_bind_text(stmt, i, cp->cfg.date_format, -1, SQLITE_STATIC);
+	if ((i = sqlite3_bind_parameter_index(stmt, ":max_post")) != 0)
+		sqlite3_bind_int64(stmt, i, cp->cfg.max_post);
+	if ((i = sqlite3_bind_parameter_index(stmt, ":max_tags")) != 0)
+		sqlite3_bind_int64(stmt, i, cp->cfg.max_tags);
+	if ((i = sqlite3_bind_parameter_index(stmt, ":stats_days")) != 0)
+		sqlite3_bind_int64(stmt, i, cp->cfg.stats_days);
+}
+
+int
+sql_int(int64_t *dest, const char *sql, ...)
+{
+	va_list ap;
+	sqlite3_stmt *stmt = NULL;
+	const char *sql_to_exec;
+	char *sqlbuf = NULL;
+	int ret = 0;
+
+	assert(sql != NULL);
+	assert(dest != NULL);
+
+	if (strchr(sql, '%') != NULL) {
+		va_start(ap, sql);
+		sqlbuf = sqlite3_vmprintf(sql, ap);
+		va_end(ap);
+		sql_to_exec = sqlbuf;
+
+		if (sqlite3_prepare_v2(cp->db, sql_to_exec, -1, &stmt, 0) != SQLITE_OK) {
+			cp_warn(false, "sqlite: %s", sqlite3_errmsg(cp->db));
+			ret = 1;
+			goto cleanup;
+		}
+	} else if ((stmt = sql_prepare(sql)) == NULL) {
+		return (1);
+	}
+
+	sql_bind_config(stmt);
+	if (sqlite3_step(stmt) == SQLITE_ROW)
+		*dest = sqlite3_column_int64(stmt, 0);
+
+cleanup:
+	if (sqlbuf != NULL) {
+		sqlite3_free(sqlbuf);
+		if (stmt != NULL)
+			sqlite3_finalize(stmt);
+	} else {
+		sqlite3_reset(stmt);
+	}
+
+	return (ret);
+}
+
+/* run a cached statement that does not return rows */
+static int
+sql_step(const char *sql)
+{
+	sqlite3_stmt *stmt;
+	int ret = 0;
+
+	if ((stmt = sql_prepare(sql)) == NULL)
+		return (-1);
+
+	sql_bind_config(stmt);
+	if (sqlite3_step(stmt) != SQLITE_DONE) {
+		cp_warn(false, "sqlite: %s (%s)", sqlite3_errmsg(cp->db), sql);
+		ret = -1;
+	}
+	sqlite3_reset(stmt);
+
+	return (ret);
+}
+
+static void
+config_free(void)
+{
+	free(cp->cfg.title);
+	free(cp->cfg.description);
+	free(cp->cfg.url);
+	free(cp->cfg.date_format);
+	memset(&cp->cfg, 0, sizeof(cp->cfg));
+}
+
+/* load the config table once */
+static bool
+config_load(void)
+{
+	sqlite3_stmt *stmt;
+	const char *key;
+	char **dest;
+
+	config_free();
+
+	if ((stmt = sql_prepare("SELECT key, value FROM config;")) == NULL)
+		return (false);
+
+	while (sqlite3_step(stmt) == SQLITE_ROW) {
+		key = (const char *)sqlite3_column_text(stmt, 0);
+		dest = NULL;
+		if (!strcmp(key, "title"))
+			dest = &cp->cfg.title;
+		else if (!strcmp(key, "description"))
+			dest = &cp->cfg.description;
+		else if (!strcmp(key, "url"))
+			dest = &cp->cfg.url;
+		else if (!strcmp(key, "date_format"))
+			dest = &cp->cfg.date_format;
+		else if (!strcmp(key, "max_post"))
+			cp->cfg.max_post = sqlite3_column_int64(stmt, 1);
+		else if (!strcmp(key, "compression"))
+			cp->cfg.compression = sqlite3_column_int64(stmt, 1);
+		else if (!strcmp(key, "dedup"))
+			cp->cfg.dedup = sqlite3_column_int64(stmt, 1);
+		else if (!strcmp(key, "max_tags"))
+			cp->cfg.max_tags = sqlite3_column_int64(stmt, 1);
+		else if (!strcmp(key, "stats_days"))
+			cp->cfg.stats_days = sqlite3_column_int64(stmt, 1);
+
+		if (dest != NULL && sqlite3_column_text(stmt, 1) != NULL)
+			*dest = strdup((const char *)sqlite3_column_text(stmt, 1));
+	}
+	sqlite3_reset(stmt);
+
+	return (true);
+}
+int
+sql_exec(const char *sql, ...)
+{
+	va_list ap;
+	const char *sql_to_exec;
+	char *sqlbuf = NULL;
+	char *errmsg;
+	int ret = -1;
+
+	assert(sql != NULL);
+	if (strchr(sql, '%') != NULL) {
+		va_start(ap, sql);
+		sqlbuf = sqlite3_vmprintf(sql, ap);
+		va_end(ap);
+		sql_to_exec = sqlbuf;
+	} else {
+		sql_to_exec = sql;
+	}
+
+	if (sqlite3_exec(cp->db, sql_to_exec, NULL, NULL, &errmsg) != SQLITE_OK) {
+		cp_warn(false, "sqlite: %s (%s)", errmsg, sql_to_exec);
+		goto cleanup;
+	}
+
+
+	ret = 0;
+cleanup:
+	if (sqlbuf != NULL)
+		sqlite3_free(sqlbuf);
+	return (ret);
+}
+
+static size_t
+write_to_buffer(void *ptr, size_t size, size_t memb, void *data) {
+	size_t realsize = size * memb;
+	UT_string *mem = (UT_string *)data;
+
+	utstring_bincpy(mem, ptr, realsize);
+
+	return (realsize);
+}
+
+/* bind a post body, deflating it if compression is enabled */
+static void
+sql_bind_body(sqlite3_stmt *stmt, int col, UT_string *body, int level)
+{
+	unsigned char *buf;
+	uLongf destlen;
+	size_t len = utstring_len(body);
+
+	if (len == 0) {
+		sqlite3_bind_null(stmt, col);
+		return;
+	}
+
+	if (level <= 0 || len < BODY_MINLEN || len > UINT32_MAX) {
+		sqlite3_bind_text(stmt, col, utstring_body(body), len, SQLITE_TRANSIENT);
+		return;
+	}
+
+	/* stored as it is rather than not at all */
+	destlen = compressBound(len);
+	if ((buf = malloc(BODY_HDRLEN + destlen)) == NULL) {
+		sqlite3_bind_text(stmt, col, utstring_body(body), len, SQLITE_TRANSIENT);
+		return;
+	}
+
+	buf[0] = (len >> 24) & 0xff;
+	buf[1] = (len >> 16) & 0xff;
+	buf[2] = (len >> 8) & 0xff;
+	buf[3] = len & 0xff;
+
+	if (compress2(buf + BODY_HDRLEN, &destlen, (const Bytef *)utstring_body(body),
+	    len, level > Z_BEST_COMPRESSION ? Z_BEST_COMPRESSION : level) != Z_OK ||
+	    destlen + BODY_HDRLEN >= len) {
+		/* not worth it */
+		free(buf);
+		sqlite3_bind_text(stmt, col, utstring_body(body), len, SQLITE_TRANSIENT);
+		return;
+	}
+
+	sqlite3_bind_blob(stmt, col, buf, BODY_HDRLEN + destlen, free);
+}
+
+/*
+ * return the text of a post body, inflating it into buf if it has been
+ * stored compressed, NULL if the column is empty
+ */
+static const char *
+sql_column_body(sqlite3_stmt *stmt, int col, UT_string *buf)
+{
+	const unsigned char *blob;
+	uLongf len;
+	int bloblen;
+
+	switch (sqlite3_column_type(stmt, col)) {
+	case SQLITE_NULL:
+		return (NULL);
+	case SQLITE_BLOB:
+		break;
+	default:
+		return ((const char *)sqlite3_column_text(stmt, col));
+	}
+
+	blob = sqlite3_column_blob(stmt, col);
+	bloblen = sqlite3_column_bytes(stmt, col);
+	if (bloblen < BODY_HDRLEN) {
+		cp_warn(false, "Invalid compressed body");
+		return (NULL);
+	}
+
+	len = (uLongf)blob[0] << 24 | (uLongf)blob[1] << 16 |
+	    (uLongf)blob[2] << 8 | (uLongf)blob[3];
+
+	utstring_clear(buf);
+	utstring_reserve(buf, len + 1);
+	if (uncompress((Bytef *)utstring_body(buf), &len, blob + BODY_HDRLEN,
+	    bloblen - BODY_HDRLEN) != Z_OK) {
+		cp_warn(false, "Unable to inflate post body");
+		return (NULL);
+	}
+	buf->i = len;
+	buf->d[len] = '\0';
+
+	return (utstring_body(buf));
+}
+
+/* extract the text of an html fragment to feed the full text index */
+static void
+html_to_text(const char *html, UT_string *out)
+{
+	const char *p, *end;
+	bool space = false;
+	long c;
+
+	utstring_clear(out);
+	if (html == NULL)
+		return;
+
+	for (p = html; *p != '\0'; p++) {
+		if (*p == '<') {
+			if ((end = strchr(p, '>')) == NULL)
+				break;
+			p = end;
+			space = true;
+			continue;
+		}
+		if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+			space = true;
+			continue;
+		}
+		if (space && utstring_len(out) > 0)
+			utstring_bincpy(out, " ", 1);
+		space = false;
+		if (*p != '&' || (end = strchr(p, ';')) == NULL || end - p > 10) {
+			utstring_bincpy(out, p, 1);
+			continue;
+		}
+		if (!strncmp(p, "&amp;", 5))
+			utstring_bincpy(out, "&", 1);
+		else if (!strncmp(p, "&lt;", 4))
+			utstring_bincpy(out, "<", 1);
+		else if (!strncmp(p, "&gt;", 4))
+			utstring_bincpy(out, ">", 1);
+		else if (!strncmp(p, "&quot;", 6))
+			utstring_bincpy(out, "\"", 1);
+		else if (!strncmp(p, "&apos;", 6))
+			utstring_bincpy(out, "'", 1);
+		else if (p[1] == '#') {
+			c = p[2] == 'x' || p[2] == 'X' ?
+			    strtol(p + 3, NULL, 16) : strtol(p + 2, NULL, 10);
+			/* only keep ascii, other characters are word separators */
+			if (c > 0x20 && c < 0x7f) {
+				char ch = c;
+				utstring_bincpy(out, &ch, 1);
+			} else
+				space = true;
+		} else
+			space = true;
+		p = end;
+	}
+}
+
+/* 64 bits FNV-1a */
+#define HASH_INIT 0xcbf29ce484222325ULL
+
+static uint64_t
+hash_update(uint64_t h, const char *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)buf[i];
+		h *= 0x100000001b3ULL;
+	}
+
+	return (h);
+}
+
+static int64_t
+hash_buf(const char *buf, size_t len)
+{
+
+	return ((int64_t)hash_update(HASH_INIT, buf, len));
+}
+
+/*
+ * canonical form of a link to spot the same article syndicated by several
+ * feeds: no scheme, lowercase host without www, no default port, no
+ * fragment, no tracking parameters and no trailing slash
+ */
+static void
+link_canonical(const char *link, UT_string *out)
+{
+	const char *p, *host, *end, *param;
+	size_t len;
+
+	utstring_clear(out);
+
+	if ((p = strstr(link, "://")) != NULL)
+		link = p + 3;
+	if (!strncasecmp(link, "www.", 4))
+		link += 4;
+
+	host = link;
+	end = host + strcspn(host, "/?#");
+	len = end - host;
+	if (len > 3 && (!strncmp(end - 3, ":80", 3)))
+		len -= 3;
+	else if (len > 4 && (!strncmp(end - 4, ":443", 4)))
+		len -= 4;
+	for (p = host; p < host + len; p++) {
+		char c = tolower((unsigned char)*p);
+		utstring_bincpy(out, &c, 1);
+	}
+
+	/* path, the query may follow its trailing slash */
+	len = strcspn(end, "?#");
+	utstring_bincpy(out, end, len);
+	end += len;
+	while (len-- > 0 && out->d[out->i - 1] == '/') {
+		out->i--;
+		out->d[out->i] = '\0';
+	}
+
+	/* query, without the tracking parameters */
+	if (*end == '?') {
+		param = end + 1;
+		len = 0;
+		while (*param != '\0' && *param != '#') {
+			len = strcspn(param, "&#");
+			if (strncmp(param, "utm_", 4) != 0 && len > 0) {
+				utstring_bincpy(out, "?", 1);
+				utstring_bincpy(out, param, len);
+			}
+			param += len;
+			if (*param == '&')
+				param++;
+		}
+	}
+}
+
+/* convert the iso format as the RFC3339 is a subset of it */
+time_t
+iso8601_to_time_t(const char *d)
+{
+	struct tm date;
+	time_t t;
+	int garbage;
+	errno = 0;
+	char *s = strdup(d);
+	memset(&date, 0, sizeof(date));
+	date.tm_isdst = -1;
+	char *pos = strptime(s, "%FT%TZ", &date);
+	if (pos == NULL) {
+		/* Modify the last HH:MM to HHMM if necessary */
+		if (s[strlen(s) - 3] == ':' ) {
+			s[strlen(s) - 3] = s[strlen(s) - 2];
+			s[strlen(s) - 2] = s[strlen(s) - 1];
+			s[strlen(s) - 1] = '\0';
+		}
+		pos = strptime(s, "%FT%T%z", &date);
+
+	}
+	if (pos == NULL) {
+		memset(&date, 0, sizeof(date));
+		date.tm_isdst = -1;
+		if (sscanf(s, "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ", &date.tm_year,
+					&date.tm_mon, &date.tm_mday, &date.tm_hour, &date.tm_min,
+					&date.tm_sec, &garbage) == 7) {
+			date.tm_year -= 1900;
+			date.tm_mon -= 1;
+			pos = s;
+		}
+
+	}
+	free(s);
+	if (pos == NULL) {
+		errno = EINVAL;
+		cp_warn(false, "Convert  ISO8601 '%s' to struct tm failed", d);
+		return 0;
+	}
+	t = mktime(&date);
+	if (t == (time_t)-1) {
+		errno = EINVAL;
+		cp_warn(false, "Convert struct tm (from '%s') to time_t failed", d);
+		return 0;
+	}
+	return t;
+}
+
+/* convert RFC822 to epoch time */
+time_t
+rfc822_to_time_t(const char *s)
+{
+	struct tm date;
+	time_t t;
+	char *pos;
+	errno = 0;
+
+	if (s == NULL) {
+		cp_warn(false, "Invalide empty date");
+		return 0;
+	}
+
+	memset(&date, 0, sizeof(date));
+	date.tm_isdst = -1;
+
+	if ((pos = strptime(s, "%a, %d %b %Y %T", &date)) == NULL) {
+		errno = EINVAL;
+		cp_warn(false, "Convert RFC822 '%s' to struct tm failed", s);
+
+		return 0;
+	}
+
+	if ((t = mktime(&date)) == -1) {
+		errno = EINVAL;
+		cp_warn(false, "Convert struct tm (from '%s') to time_t failed", s);
+		return 0;
+	}
+
+	return t;
+}
+
+/*
+ * Dates are formatted here rather than with strftime() in the queries. The
+ * posts come sorted by date so the broken down day and its date_format
+ * rendering are kept from one post to the next, only the time of day is
+ * filled in again.
+ */
+static const char *wdays[] = {
+	"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+};
+static const char *months[] = {
+	"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+	"Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+static _Thread_local struct {
+	bool set;
+	int64_t date;		/* date of the last formatted post */
+	int64_t day;		/* day and format of the cached struct tm */
+	char format[128];
+	bool timeless;		/* format does not depend on the time of day */
+	struct tm tm;
+	char dayformated[128];
+	struct dates dates;
+} datecache;
+
+/* whether a strftime() format uses the time of day */
+static bool
+format_has_time(const char *fmt)
+{
+	while ((fmt = strchr(fmt, '%')) != NULL) {
+		fmt++;
+		if (*fmt == 'E' || *fmt == 'O')
+			fmt++;
+		if (*fmt == '\0')
+			break;
+		if (strchr("cHIklMpPrRsSTX", *fmt) != NULL)
+			return (true);
+		fmt++;
+	}
+
+	return (false);
+}
+
+/* the RFC822, ISO8601 and date_format representations of an UTC date */
+const struct dates *
+post_dates(int64_t date, const char *format)
+{
+	struct dates *d = &datecache.dates;
+	struct tm *tm = &datecache.tm;
+	int64_t day, secs;
+	time_t t;
+
+	if (format == NULL)
+		format = "";
+	if (datecache.set && datecache.date == date &&
+	    strcmp(datecache.format, format) == 0)
+		return (d);
+
+	day = date / 86400;
+	secs = date % 86400;
+	if (secs < 0) {
+		secs += 86400;
+		day--;
+	}
+
+	if (!datecache.set || datecache.day != day ||
+	    strcmp(datecache.format, format) != 0) {
+		t = (time_t)(day * 86400);
+		if (gmtime_r(&t, tm) == NULL)
+			memset(tm, 0, sizeof(*tm));
+		datecache.day = day;
+		snprintf(datecache.format, sizeof(datecache.format), "%s", format);
+		datecache.timeless = !format_has_time(format);
+		if (!datecache.timeless ||
+		    strftime(datecache.dayformated,
+		    sizeof(datecache.dayformated), format, tm) == 0)
+			datecache.dayformated[0] = '\0';
+	}
+	datecache.set = true;
+	datecache.date = date;
+
+	tm->tm_hour = secs / 3600;
+	tm->tm_min = secs / 60 % 60;
+	tm->tm_sec = secs % 60;
+
+	snprintf(d->rfc822, sizeof(d->rfc822),
+	    "%s, %02d %s %04d %02d:%02d:%02d +0000",
+	    wdays[tm->tm_wday % 7], tm->tm_mday, months[tm->tm_mon % 12],
+	    tm->tm_year + 1900, tm->tm_hour, tm->tm_min, tm->tm_sec);
+	snprintf(d->iso8601, sizeof(d->iso8601),
+	    "%04d-%02d-%02dT%02d:%02d:%02dZ",
+	    tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
+	    tm->tm_hour, tm->tm_min, tm->tm_sec);
+	if (datecache.timeless)
+		memcpy(d->formated, datecache.dayformated, sizeof(d->formated));
+	else if (strftime(d->formated, sizeof(d->formated), format, tm) == 0)
+		d->formated[0] = '\0';
+
+	return (d);
+}
+
+static void
+parse_atom_el(struct feed *feed, const char *elt, const char **attr)
+{
+	int i;
+	bool getlink = false;
+	char *url = NULL;
+
+	if (!strcmp(feed->xmlpath->data, "/feed/entry/link")) {
+		for (i = 0; attr[i] != NULL; i++) {
+			if (!strcmp(attr[i], "rel")) {
+				i++;
+				if (!strcmp(attr[i], "alternate"))
+					getlink = true;
+			}
+			if (!strcmp(attr[i], "href")) {
+				i++;
+				url=strdup(attr[i]);
+			}
+		}
+		if (getlink && url != NULL) {
+			utstring_clear(feed->link);
+			utstring_bincpy(feed->link, url, strlen(url));
+		}
+		free(url);
+	}
+
+	if (!strcmp(feed->xmlpath->data, "/feed/entry/category")) {
+		for (i = 0; attr[i] != NULL; i++) {
+			if (!strcmp(attr[i], "term")) {
+				i++;
+				utarray_push_back(feed->tag, &attr[i]);
+			}
+		}
+	}
+}
+
+static void XMLCALL
+xml_startel(void *userdata, const char *elt, const char **attr)
+{
+	struct feed *feed = (struct feed *)userdata;
+
+	if (feed->xmlpath->cap <= feed->xmlpath->size + strlen(elt) + 1) {
+		feed->xmlpath->cap *= 2;
+		feed->xmlpath->data = realloc(feed->xmlpath->data, feed->xmlpath->cap);
+	}
+	strcat(feed->xmlpath->data, "/");
+	strcat(feed->xmlpath->data, elt);
+	feed->xmlpath->size += strlen(elt) + 1;
+
+	utstring_clear(feed->data);
+
+	switch (feed->type) {
+		case NONE:
+			if (!strcmp(elt, "feed"))
+				feed->type = ATOM;
+			else if (!strcmp(elt, "rss"))
+				feed->type = RSS;
+			else
+				feed->type = UNKNOWN;
+			break;
+		case ATOM:
+			parse_atom_el(feed, elt, attr);
+			break;
+		case RSS:
+		case UNKNOWN:
+			break;
+	}
+}
+
+/* rowid of the version of the post already stored, 0 if this is a new one */
+static int64_t
+post_rowid(struct feed *feed, int64_t *hash)
+{
+	int64_t rowid = 0;
+
+	*hash = 0;
+	sqlite3_bind_text(feed->lookup, 1, utstring_body(feed->uid), -1, SQLITE_STATIC);
+	if (sqlite3_step(feed->lookup) == SQLITE_ROW) {
+		rowid = sqlite3_column_int64(feed->lookup, 0);
+		*hash = sqlite3_column_int64(feed->lookup, 1);
+	}
+	sqlite3_reset(feed->lookup);
+
+	return (rowid);
+}
+
+/* flag the archive pages showing the post, before and after it changes */
+static void
+archive_touch(struct feed *feed, const char *uid)
+{
+	sqlite3_bind_text(feed->archive_touch, 1, uid, -1, SQLITE_STATIC);
+	if (sqlite3_step(feed->archive_touch) != SQLITE_DONE)
+		cp_warn(false, "sqlite: %s", sqlite3_errmsg(cp->db));
+	sqlite3_reset(feed->archive_touch);
+}
+
+/* drop the previous version of the post from the full text index */
+static void
+fts_unindex_post(struct feed *feed, int64_t rowid)
+{
+	sqlite3_bind_int64(feed->fts_delete, 1, rowid);
+	if (sqlite3_step(feed->fts_delete) != SQLITE_DONE)
+		cp_warn(false, "sqlite: %s", sqlite3_errmsg(cp->db));
+	sqlite3_reset(feed->fts_delete);
+}
+
+/* fill the recent window back with the newest posts */
+static void
+recent_refill(void)
+{
+	sqlite3_stmt *stmt;
+
+	if ((stmt = sql_prepare("INSERT OR IGNORE INTO recent " RECENT_SELECT
+	    "ORDER BY date DESC, uid DESC LIMIT " MAX_POST ";")) == NULL)
+		return;
+	sql_bind_config(stmt);
+	if (sqlite3_step(stmt) != SQLITE_DONE)
+		cp_warn(false, "sqlite: %s", sqlite3_errmsg(cp->db));
+	sqlite3_reset(stmt);
+}
+
+/*
+ * keep the recent window up to date: the replaced version of the post
+ * leaves it, the new one enters it unless it is older than the oldest post
+ * of a full window, which the trim sorts out for the posts of its date
+ */
+static void
+recent_push(struct feed *feed, int64_t oldrowid, int64_t rowid)
+{
+	int removed = 0;
+
+	if (oldrowid != 0) {
+		sqlite3_bind_int64(feed->recent_delete, 1, oldrowid);
+		if (sqlite3_step(feed->recent_delete) != SQLITE_DONE)
+			cp_warn(false, "sqlite: %s", sqlite3_errmsg(cp->db));
+		removed = sqlite3_changes(cp->db);
+		sqlite3_reset(feed->recent_delete);
+	}
+
+	sqlite3_bind_int64(feed->recent_insert, 1, rowid);
+	sql_bind_config(feed->recent_insert);
+	if (sqlite3_step(feed->recent_insert) != SQLITE_DONE)
+		cp_warn(false, "sqlite: %s", sqlite3_errmsg(cp->db));
+	sqlite3_reset(feed->recent_insert);
+
+	if (sqlite3_changes(cp->db) > 0) {
+		sql_bind_config(feed->recent_trim);
+		if (sqlite3_step(feed->recent_trim) != SQLITE_DONE)
+			cp_warn(false, "sqlite: %s", sqlite3_errmsg(cp->db));
+		sqlite3_reset(feed->recent_trim);
+	} else if (removed > 0) {
+		/* the post got older and left a hole in the window */
+		recent_refill();
+	}
+}
+
+static void
+fts_index_post(struct feed *feed, int64_t rowid, UT_string *text)
+{
+	UT_string *tags;
+	char **p = NULL;
+
+	utstring_new(tags);
+
+	while ((p = (char **)utarray_next(feed->tag, p)) != NULL)
+		utstring_printf(tags, "%s%s", utstring_len(tags) > 0 ? " " : "", *p);
+
+	sqlite3_bind_int64(feed->fts_insert, 1, rowid);
+	sqlite3_bind_text(feed->fts_insert, 2, utstring_body(tags), -1, SQLITE_STATIC);
+	sqlite3_bind_text(feed->fts_insert, 3, utstring_body(text), -1, SQLITE_STATIC);
+	if (sqlite3_step(feed->fts_insert) != SQLITE_DONE)
+		cp_warn(false, "sqlite: %s", sqlite3_errmsg(cp->db));
+	sqlite3_reset(feed->fts_insert);
+
+	utstring_free(tags);
+}
+
+/*
+ * look for the primary copy of an entry already stored from another feed,
+ * if found the entry is only recorded as a reference to it
+ */
+static bool
+dedup_entry(struct feed *feed, int64_t linkkey, int64_t contentkey, int64_t oldrowid)
+{
+	char *primary;
+	char **p = NULL;
+	int newtags = 0;
+
+	if (linkkey != 0)
+		sqlite3_bind_int64(feed->dup_lookup, 1, linkkey);
+	else
+		sqlite3_bind_null(feed->dup_lookup, 1);
+	if (contentkey != 0)
+		sqlite3_bind_int64(feed->dup_lookup, 2, contentkey);
+	else
+		sqlite3_bind_null(feed->dup_lookup, 2);
+	sqlite3_bind_text(feed->dup_lookup, 3, utstring_body(feed->uid), -1, SQLITE_STATIC);
+	if (sqlite3_step(feed->dup_lookup) != SQLITE_ROW) {
+		sqlite3_reset(feed->dup_lookup);
+		return (false);
+	}
+	primary = strdup((const char *)sqlite3_column_text(feed->dup_lookup, 0));
+	sqlite3_reset(feed->dup_lookup);
+
+	sqlite3_bind_text(feed->dup_insert, 1, utstring_body(feed->uid), -1, SQLITE_STATIC);
+	sqlite3_bind_text(feed->dup_insert, 2, (const char *)feed->name, -1, SQLITE_STATIC);
+	sqlite3_bind_text(feed->dup_insert, 3, primary, -1, SQLITE_STATIC);
+	if (sqlite3_step(feed->dup_insert) != SQLITE_DONE)
+		cp_warn(false, "sqlite: %s", sqlite3_errmsg(cp->db));
+	sqlite3_reset(feed->dup_insert);
+
+	/* stored as a post before being recognised as a duplicate */
+	if (oldrowid != 0) {
+		archive_touch(feed, utstring_body(feed->uid));
+		if (cp->has_fts)
+			fts_unindex_post(feed, oldrowid);
+		sqlite3_bind_int64(feed->post_delete, 1, oldrowid);
+		if (sqlite3_step(feed->post_delete) != SQLITE_DONE)
+			cp_warn(false, "sqlite: %s", sqlite3_errmsg(cp->db));
+		sqlite3_reset(feed->post_delete);
+	}
+
+	/* the primary copy gathers the tags of all the copies */
+	sqlite3_bind_text(feed->tags, 1, primary, -1, SQLITE_STATIC);
+	while ((p = (char **)utarray_next(feed->tag, p)) != NULL) {
+		sqlite3_bind_text(feed->tags, 2, *p, -1, SQLITE_STATIC);
+		if (sqlite3_step(feed->tags) == SQLITE_DONE)
+			newtags += sqlite3_changes(cp->db);
+		sqlite3_reset(feed->tags);
+	}
+	sqlite3_bind_text(feed->tags, 1, utstring_body(feed->uid), -1, SQLITE_TRANSIENT);
+	if (newtags > 0) {
+		archive_touch(feed, primary);
+		/* exported again with its new tags */
+		sqlite3_bind_text(feed->post_touch, 1, primary, -1, SQLITE_STATIC);
+		if (sqlite3_step(feed->post_touch) != SQLITE_DONE)
+			cp_warn(false, "sqlite: %s", sqlite3_errmsg(cp->db));
+		sqlite3_reset(feed->post_touch);
+	}
+	free(primary);
+
+	return (true);
+}
+
+/* store the entry which has just been parsed */
+static void
+store_entry(struct feed *feed)
+{
+	UT_string *text, *canon;
+	int64_t oldrowid, rowid, linkkey = 0, contentkey = 0, oldhash;
+	uint64_t hash;
+	char **p;
+
+	feed->stats->seen++;
+	/* what the entry elements do not hold */
+	hash = hash_update(feed->hash, (const char *)feed->name,
+	    strlen((const char *)feed->name) + 1);
+	hash = hash_update(hash, utstring_body(feed->blog_title),
+	    utstring_len(feed->blog_title) + 1);
+	if (!feed->has_author)
+		hash = hash_update(hash, utstring_body(feed->author),
+		    utstring_len(feed->author) + 1);
+	hash = hash_update(hash, utstring_body(feed->link),
+	    utstring_len(feed->link) + 1);
+	p = NULL;
+	while ((p = (char **)utarray_next(feed->tag, p)) != NULL)
+		hash = hash_update(hash, *p, strlen(*p) + 1);
+
+	/* feeds carry the same entries for long, do not rewrite them */
+	oldrowid = post_rowid(feed, &oldhash);
+	if (oldrowid != 0 && oldhash == (int64_t)hash) {
+		feed->stats->skipped++;
+		return;
+	}
+
+	utstring_new(text);
+	html_to_text(utstring_len(feed->content) > 0 ?
+	    utstring_body(feed->content) : utstring_body(feed->description), text);
+
+	if (cp->cfg.dedup) {
+		if (utstring_len(feed->link) > 0) {
+			utstring_new(canon);
+			link_canonical(utstring_body(feed->link), canon);
+			linkkey = hash_buf(utstring_body(canon), utstring_len(canon));
+			utstring_free(canon);
+			/* entries all linking to the blog are not the same post */
+			if (linkkey == feed->home_key)
+				linkkey = 0;
+		}
+		if (utstring_len(text) >= DEDUP_MINLEN)
+			contentkey = hash_buf(utstring_body(text), utstring_len(text));
+		if ((linkkey != 0 || contentkey != 0) &&
+		    dedup_entry(feed, linkkey, contentkey, oldrowid)) {
+			feed->stats->skipped++;
+			utstring_free(text);
+			return;
+		}
+	}
+
+	sqlite3_bind_text(feed->stmt, 2, (const char *)feed->name, -1, SQLITE_STATIC);
+	sqlite3_bind_text(feed->stmt, 3, utstring_body(feed->blog_title), -1, SQLITE_STATIC);
+	if (!feed->has_author)
+		sqlite3_bind_text(feed->stmt, 5, utstring_body(feed->author), -1, SQLITE_TRANSIENT);
+	if (utstring_len(feed->link) > 0)
+		sqlite3_bind_text(feed->stmt, 6, utstring_body(feed->link), -1, SQLITE_STATIC);
+	else
+		sqlite3_bind_null(feed->stmt, 6);
+	if (linkkey != 0)
+		sqlite3_bind_int64(feed->stmt, 12, linkkey);
+	else
+		sqlite3_bind_null(feed->stmt, 12);
+	if (contentkey != 0)
+		sqlite3_bind_int64(feed->stmt, 13, contentkey);
+	else
+		sqlite3_bind_null(feed->stmt, 13);
+
+	sqlite3_bind_int64(feed->stmt, 14, (int64_t)hash);
+
+	if (oldrowid != 0)
+		archive_touch(feed, utstring_body(feed->uid));
+	sql_bind_body(feed->stmt, 7, feed->content, feed->compression);
+	/* only keep one copy when the description is the content */
+	if (utstring_len(feed->content) == utstring_len(feed->description) &&
+	    memcmp(utstring_body(feed->content), utstring_body(feed->description),
+	    utstring_len(feed->content)) == 0)
+		sqlite3_bind_null(feed->stmt, 8);
+	else
+		sql_bind_body(feed->stmt, 8, feed->description, feed->compression);
+	/* the old row is left as it was, the last rowid is another one's */
+	if (sqlite3_step(feed->stmt) != SQLITE_DONE) {
+		cp_warn(false, "sqlite3: grr: %s", sqlite3_errmsg(cp->db));
+		sqlite3_reset(feed->stmt);
+		utstring_free(text);
+		return;
+	}
+	feed->stats->inserted++;
+	sqlite3_reset(feed->stmt);
+	rowid = sqlite3_last_insert_rowid(cp->db);
+	if (cp->has_fts) {
+		if (oldrowid != 0)
+			fts_unindex_post(feed, oldrowid);
+		fts_index_post(feed, rowid, text);
+	}
+	recent_push(feed, oldrowid, rowid);
+
+	p = NULL;
+	while (( p = (char **)utarray_next(feed->tag, p)) != NULL) {
+		sqlite3_bind_text(feed->tags, 2, *p, -1, SQLITE_STATIC);
+		sqlite3_step(feed->tags);
+		sqlite3_reset(feed->tags);
+	}
+	archive_touch(feed, utstring_body(feed->uid));
+
+	utstring_free(text);
+}
+
+static void XMLCALL
+xml_endel(void *userdata, const char *elt)
+{
+	struct feed *feed = (struct feed *)userdata;
+	struct timespec start;
+
+	/* fingerprint of the entry as published */
+	if (!strncmp(feed->xmlpath->data, "/feed/entry/", 12) ||
+	    !strncmp(feed->xmlpath->data, "/rss/channel/item/", 18)) {
+		feed->hash = hash_update(feed->hash, feed->xmlpath->data,
+		    feed->xmlpath->size + 1);
+		feed->hash = hash_update(feed->hash, utstring_body(feed->data),
+		    utstring_len(feed->data) + 1);
+	}
+
+	if (!strcmp(feed->xmlpath->data, "/feed/entry/id") ||
+	    !strcmp(feed->xmlpath->data, "/rss/channel/item/guid")) {
+		sqlite3_bind_text(feed->stmt, 1, utstring_body(feed->data), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_text(feed->tags, 1, utstring_body(feed->data), -1, SQLITE_TRANSIENT);
+		utstring_clear(feed->uid);
+		utstring_concat(feed->uid, feed->data);
+	}
+	if (!strcmp(feed->xmlpath->data, "/feed/entry/title") ||
+	    !strcmp(feed->xmlpath->data, "/rss/channel/item/title")) {
+		sqlite3_bind_text(feed->stmt, 4, utstring_body(feed->data), -1, SQLITE_TRANSIENT);
+	}
+	if (!strcmp(feed->xmlpath->data, "/feed/entry/author/name") ||
+	    !strcmp(feed->xmlpath->data, "/rss/channel/item/dc:creator")) {
+		feed->has_author=true;
+		sqlite3_bind_text(feed->stmt, 5, utstring_body(feed->data), -1, SQLITE_TRANSIENT);
+	}
+	if (!strcmp(feed->xmlpath->data, "/feed/entry/published"))
+		sqlite3_bind_int64(feed->stmt, 9, iso8601_to_time_t(utstring_body(feed->data)));
+	if (!strcmp(feed->xmlpath->data, "/feed/entry/updated"))
+		sqlite3_bind_int64(feed->stmt, 10, iso8601_to_time_t(utstring_body(feed->data)));
+	if (!strcmp(feed->xmlpath->data, "/rss/channel/item/pubDate")) {
+		sqlite3_bind_int64(feed->stmt, 9, rfc822_to_time_t(utstring_body(feed->data)));
+		sqlite3_bind_int64(feed->stmt, 10, rfc822_to_time_t(utstring_body(feed->data)));
+	}
+	if (!strcmp(feed->xmlpath->data, "/rss/channel/item/category"))
+		utarray_push_back(feed->tag, &utstring_body(feed->data));
+	if (!strcmp(feed->xmlpath->data, "/feed/entry/content") ||
+	    !strcmp(feed->xmlpath->data, "/rss/channel/item/content:encoded")) {
+		utstring_clear(feed->content);
+		utstring_concat(feed->content, feed->data);
+	}
+
+	if (!strcmp(feed->xmlpath->data, "/rss/channel/item/link")) {
+		utstring_clear(feed->link);
+		utstring_concat(feed->link, feed->data);
+	}
+
+	if (!strcmp(feed->xmlpath->data, "/rss/channel/item/description")) {
+		utstring_clear(feed->description);
+		utstring_concat(feed->description, feed->data);
+	}
+
+	if (!strcmp(feed->xmlpath->data, "/rss/channel/item") ||
+	    !strcmp(feed->xmlpath->data, "/feed/entry")) {
+		phase_enter(PHASE_DB);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		store_entry(feed);
+		cp->phase_ms[PHASE_DB] += elapsed_ms(&start);
+		phase_enter(PHASE_PARSE);
+		TRACE_SPAN("db", "store", &start, "feed", (const char *)feed->name, -1);
+		feed->hash = HASH_INIT;
+		utstring_clear(feed->content);
+		utstring_clear(feed->description);
+		utstring_clear(feed->uid);
+		utstring_clear(feed->link);
+		utarray_clear(feed->tag);
+		feed->has_author = false;
+	}
+	feed->xmlpath->size -= strlen(elt);
+	feed->xmlpath->data[feed->xmlpath->size] = '\0';
+	if (feed->xmlpath->data[feed->xmlpath->size - 1] != '/')
+		cp_warn(false, "invalid xml");
+
+	feed->xmlpath->size--;
+	feed->xmlpath->data[feed->xmlpath->size] = '\0';
+}
+
+static void XMLCALL
+xml_data(void *userdata, const char *s, int len)
+{
+	struct feed *feed = (struct feed *)userdata;
+
+	if (!strcmp(feed->xmlpath->data, "/feed/title") ||
+	    !strcmp(feed->xmlpath->data, "/rss/channel/title"))
+		utstring_bincpy(feed->blog_title, s, len);
+	if (!strcmp(feed->xmlpath->data, "/feed/author/name"))
+		utstring_bincpy(feed->author, s, len);
+	utstring_bincpy(feed->data, s, len);
+}
+
+/*
+ * the rendered chunks are written as they come to the file and to its
+ * compressed copies, each one to a temporary file renamed in place once
+ * complete
+ */
+struct sibling {
+	int kind;
+	FILE *out;
+	char *tmppath;
+	z_stream z;
+#ifdef HAVE_BROTLI
+	BrotliEncoderState *br;
+#endif
+#ifdef HAVE_ZSTD
+	ZSTD_CCtx *zstd;
+#endif
+};
+
+/*
+ * Outputs can be minified while they are written, in a single pass: runs of
+ * whitespace are collapsed, comments are dropped and the content of CDATA
+ * sections and of pre, textarea, script and style elements is kept as is.
+ */
+enum {
+	MINIFY_TEXT,
+	MINIFY_OPEN,		/* "<" and what follows until it is known */
+	MINIFY_TAG,
+	MINIFY_QUOTE,		/* attribute value */
+	MINIFY_COMMENT,
+	MINIFY_CDATA,
+	MINIFY_RAW		/* until the closing tag of a pre, script... */
+};
+
+struct minify {
+	int state;
+	char space;		/* whitespace pending before what comes next */
+	char quote;
+	bool raw;		/* the tag opens a raw element */
+	char open[16];
+	size_t openlen;
+	char closing[16];	/* "</name" ending the raw element */
+	size_t match;		/* how much of the end marker was seen */
+	char out[BUFSIZ];
+	size_t outlen;
+};
+
+struct sink {
+	FILE *out;
+	char *tmppath;
+	size_t bytes;		/* written to out */
+	struct sibling sib[SIBLING_MAX];
+	int nsib;
+	struct minify *minify;
+};
+
+static mode_t filemode = 0644;	/* what fopen(3) would create */
+
+static FILE *
+tmpfile_open(const char *path, char **tmppath)
+{
+	FILE *f;
+	int fd;
+
+	if (asprintf(tmppath, "%s.XXXXXX", path) == -1) {
+		*tmppath = NULL;
+		return (NULL);
+	}
+	if ((fd = mkstemp(*tmppath)) == -1) {
+		free(*tmppath);
+		*tmppath = NULL;
+		return (NULL);
+	}
+	/* mkstemp(3) creates the file 0600 */
+	fchmod(fd, filemode);
+	if ((f = fdopen(fd, "w")) == NULL) {
+		close(fd);
+		unlink(*tmppath);
+		free(*tmppath);
+		*tmppath = NULL;
+	}
+
+	return (f);
+}
+
+static void
+sibling_free(struct sibling *sib)
+{
+	switch (sib->kind) {
+	case SIBLING_GZIP:
+		deflateEnd(&sib->z);
+		break;
+#ifdef HAVE_BROTLI
+	case SIBLING_BROTLI:
+		BrotliEncoderDestroyInstance(sib->br);
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case SIBLING_ZSTD:
+		ZSTD_freeCCtx(sib->zstd);
+		break;
+#endif
+	}
+}
+
+static int
+sibling_init(struct sibling *sib, int kind, int64_t level)
+{
+	memset(sib, 0, sizeof(struct sibling));
+	sib->kind = kind;
+
+	switch (kind) {
+	case SIBLING_GZIP:
+		/* 16 more window bits for the gzip header */
+		if (deflateInit2(&sib->z, level, Z_DEFLATED, 15 + 16, 8,
+		    Z_DEFAULT_STRATEGY) != Z_OK)
+			return (-1);
+		break;
+#ifdef HAVE_BROTLI
+	case SIBLING_BROTLI:
+		if ((sib->br = BrotliEncoderCreateInstance(NULL, NULL, NULL)) == NULL)
+			return (-1);
+		BrotliEncoderSetParameter(sib->br, BROTLI_PARAM_QUALITY, level);
+		BrotliEncoderSetParameter(sib->br, BROTLI_PARAM_MODE,
+		    BROTLI_MODE_TEXT);
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case SIBLING_ZSTD:
+		if ((sib->zstd = ZSTD_createCCtx()) == NULL)
+			return (-1);
+		if (ZSTD_isError(ZSTD_CCtx_setParameter(sib->zstd,
+		    ZSTD_c_compressionLevel, level))) {
+			ZSTD_freeCCtx(sib->zstd);
+			return (-1);
+		}
+		break;
+#endif
+	default:
+		return (-1);
+	}
+
+	return (0);
+}
+
+/* compress len bytes of buf, and end the stream if finish is set */
+static int
+sibling_write(struct sibling *sib, const char *buf, size_t len, bool finish)
+{
+	unsigned char out[BUFSIZ];
+	int ret;
+#ifdef HAVE_BROTLI
+	const uint8_t *next_in;
+	uint8_t *next_out;
+	size_t avail_in, avail_out;
+#endif
+#ifdef HAVE_ZSTD
+	ZSTD_inBuffer zin;
+	ZSTD_outBuffer zout;
+	size_t left;
+#endif
+
+	switch (sib->kind) {
+	case SIBLING_GZIP:
+		sib->z.next_in = (unsigned char *)buf;
+		sib->z.avail_in = len;
+		do {
+			sib->z.next_out = out;
+			sib->z.avail_out = sizeof(out);
+			ret = deflate(&sib->z, finish ? Z_FINISH : Z_NO_FLUSH);
+			if (ret == Z_STREAM_ERROR)
+				return (-1);
+			if (fwrite(out, 1, sizeof(out) - sib->z.avail_out,
+			    sib->out) != sizeof(out) - sib->z.avail_out)
+				return (-1);
+		} while (sib->z.avail_out == 0);
+		break;
+#ifdef HAVE_BROTLI
+	case SIBLING_BROTLI:
+		next_in = (const uint8_t *)buf;
+		avail_in = len;
+		do {
+			next_out = out;
+			avail_out = sizeof(out);
+			if (!BrotliEncoderCompressStream(sib->br, finish ?
+			    BROTLI_OPERATION_FINISH : BROTLI_OPERATION_PROCESS,
+			    &avail_in, &next_in, &avail_out, &next_out, NULL))
+				return (-1);
+			if (fwrite(out, 1, sizeof(out) - avail_out, sib->out) !=
+			    sizeof(out) - avail_out)
+				return (-1);
+		} while (avail_in > 0 || BrotliEncoderHasMoreOutput(sib->br) ||
+		    (finish && !BrotliEncoderIsFinished(sib->br)));
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case SIBLING_ZSTD:
+		zin.src = buf;
+		zin.size = len;
+		zin.pos = 0;
+		do {
+			zout.dst = out;
+			zout.size = sizeof(out);
+			zout.pos = 0;
+			left = ZSTD_compressStream2(sib->zstd, &zout, &zin,
+			    finish ? ZSTD_e_end : ZSTD_e_continue);
+			if (ZSTD_isError(left))
+				return (-1);
+			if (fwrite(out, 1, zout.pos, sib->out) != zout.pos)
+				return (-1);
+		} while (finish ? left != 0 : zin.pos < zin.size);
+		break;
+#endif
+	default:
+		return (-1);
+	}
+
+	return (0);
+}
+
+/* open the temporary files of the output and of its wanted copies */
+static int
+sink_open(struct sink *sink, const char *path, const int64_t *levels,
+    bool minify)
+{
+	struct sibling *sib;
+	char *sibpath;
+	int i;
+
+	memset(sink, 0, sizeof(struct sink));
+	if ((sink->out = tmpfile_open(path, &sink->tmppath)) == NULL)
+		return (-1);
+	if (minify &&
+	    (sink->minify = calloc(1, sizeof(struct minify))) == NULL)
+		return (-1);
+
+	for (i = 0; i < SIBLING_MAX; i++) {
+		if (levels[i] == 0 || !sibling_kinds[i].supported)
+			continue;
+		sib = &sink->sib[sink->nsib];
+		if (sibling_init(sib, i, levels[i]) != 0) {
+			errno = ENOMEM;
+			return (-1);
+		}
+		sink->nsib++;
+		if (asprintf(&sibpath, "%s%s", path, sibling_kinds[i].suffix) == -1)
+			return (-1);
+		sib->out = tmpfile_open(sibpath, &sib->tmppath);
+		free(sibpath);
+		if (sib->out == NULL)
+			return (-1);
+	}
+
+	return (0);
+}
+
+static int
+sink_emit(struct sink *sink, const char *buf, size_t len)
+{
+	int i;
+
+	if (fwrite(buf, 1, len, sink->out) != len)
+		return (-1);
+	sink->bytes += len;
+	for (i = 0; i < sink->nsib; i++) {
+		if (sibling_write(&sink->sib[i], buf, len, false) != 0)
+			return (-1);
+	}
+
+	return (0);
+}
+
+static int
+minify_put(struct sink *sink, const char *buf, size_t len)
+{
+	struct minify *m = sink->minify;
+
+	if (m->outlen + len > sizeof(m->out)) {
+		if (sink_emit(sink, m->out, m->outlen) != 0)
+			return (-1);
+		m->outlen = 0;
+		if (len > sizeof(m->out))
+			return (sink_emit(sink, buf, len));
+	}
+	memcpy(m->out + m->outlen, buf, len);
+	m->outlen += len;
+
+	return (0);
+}
+
+/* the whitespace collapsed before what is written next */
+static int
+minify_space(struct sink *sink)
+{
+	struct minify *m = sink->minify;
+	int ret = 0;
+
+	if (m->space != '\0')
+		ret = minify_put(sink, &m->space, 1);
+	m->space = '\0';
+
+	return (ret);
+}
+
+/* the markup started by "<" is a tag, see if it opens a raw element */
+static void
+minify_tag(struct minify *m)
+{
+	static const char *raw[] = { "pre", "textarea", "script", "style" };
+	size_t i;
+
+	m->raw = false;
+	if (m->openlen < 2 || m->open[1] == '/')
+		return;
+	for (i = 0; i < sizeof(raw) / sizeof(raw[0]); i++) {
+		if (strlen(raw[i]) == m->openlen - 1 &&
+		    strncasecmp(m->open + 1, raw[i], m->openlen - 1) == 0) {
+			snprintf(m->closing, sizeof(m->closing), "</%s", raw[i]);
+			m->raw = true;
+		}
+	}
+}
+
+static int
+minify_write(struct sink *sink, const char *buf, size_t len)
+{
+	static const char comment[] = "<!--", cdata[] = "<![CDATA[";
+	struct minify *m = sink->minify;
+	const char *end = buf + len;
+	char c;
+	int ret = 0;
+
+	for (; buf < end && ret == 0; buf++) {
+		c = *buf;
+again:
+		switch (m->state) {
+		case MINIFY_TEXT:
+			if (isspace((unsigned char)c)) {
+				if (c == '\n' || m->space == '\0')
+					m->space = c == '\n' ? '\n' : ' ';
+			} else if (c == '<') {
+				m->open[0] = c;
+				m->openlen = 1;
+				m->state = MINIFY_OPEN;
+			} else if ((ret = minify_space(sink)) == 0)
+				ret = minify_put(sink, &c, 1);
+			break;
+		case MINIFY_OPEN:
+			/* as for a browser, a "<" starting no markup is text */
+			if (m->openlen == 1 && !isalpha((unsigned char)c) &&
+			    c != '/' && c != '!' && c != '?') {
+				if ((ret = minify_space(sink)) == 0)
+					ret = minify_put(sink, m->open, 1);
+				m->state = MINIFY_TEXT;
+				goto again;
+			}
+			m->open[m->openlen++] = c;
+			if (m->openlen == sizeof(comment) - 1 &&
+			    memcmp(m->open, comment, m->openlen) == 0) {
+				m->state = MINIFY_COMMENT;
+				m->match = 0;
+			} else if (m->openlen == sizeof(cdata) - 1 &&
+			    memcmp(m->open, cdata, m->openlen) == 0) {
+				if ((ret = minify_space(sink)) == 0)
+					ret = minify_put(sink, m->open, m->openlen);
+				m->state = MINIFY_CDATA;
+				m->match = 0;
+			} else if ((m->openlen < sizeof(comment) &&
+			    memcmp(m->open, comment, m->openlen) == 0) ||
+			    (m->openlen < sizeof(cdata) &&
+			    memcmp(m->open, cdata, m->openlen) == 0)) {
+				/* maybe a comment or CDATA, wait for more */
+			} else if (m->openlen < sizeof(m->open) &&
+			    (isalnum((unsigned char)c) ||
+			    (m->openlen == 2 && c == '/'))) {
+				/* the name of the tag */
+			} else {
+				m->openlen--;
+				minify_tag(m);
+				if ((ret = minify_space(sink)) == 0)
+					ret = minify_put(sink, m->open, m->openlen);
+				m->state = MINIFY_TAG;
+				goto again;
+			}
+			break;
+		case MINIFY_TAG:
+			if (isspace((unsigned char)c)) {
+				m->space = ' ';
+				break;
+			}
+			if (c != '>' && (ret = minify_space(sink)) != 0)
+				break;
+			m->space = '\0';
+			if (c == '"' || c == '\'') {
+				m->quote = c;
+				m->state = MINIFY_QUOTE;
+			} else if (c == '>') {
+				m->state = m->raw ? MINIFY_RAW : MINIFY_TEXT;
+				m->raw = false;
+				m->match = 0;
+			}
+			ret = minify_put(sink, &c, 1);
+			break;
+		case MINIFY_QUOTE:
+			if (c == m->quote)
+				m->state = MINIFY_TAG;
+			ret = minify_put(sink, &c, 1);
+			break;
+		case MINIFY_COMMENT:
+			if (c == '-')
+				m->match = MIN(m->match + 1, 2);
+			else if (c == '>' && m->match == 2)
+				m->state = MINIFY_TEXT;
+			else
+				m->match = 0;
+			break;
+		case MINIFY_CDATA:
+			if (c == ']')
+				m->match = MIN(m->match + 1, 2);
+			else if (c == '>' && m->match == 2)
+				m->state = MINIFY_TEXT;
+			else
+				m->match = 0;
+			ret = minify_put(sink, &c, 1);
+			break;
+		case MINIFY_RAW:
+			if (tolower((unsigned char)c) == m->closing[m->match])
+				m->match++;
+			else
+				m->match = c == '<' ? 1 : 0;
+			if (m->closing[m->match] == '\0')
+				m->state = MINIFY_TAG;
+			ret = minify_put(sink, &c, 1);
+			break;
+		}
+	}
+
+	return (ret);
+}
+
+/* write what was held back waiting for more */
+static int
+minify_finish(struct sink *sink)
+{
+	struct minify *m = sink->minify;
+
+	if (m->state == MINIFY_OPEN && (minify_space(sink) != 0 ||
+	    minify_put(sink, m->open, m->openlen) != 0))
+		return (-1);
+	if (minify_space(sink) != 0 || sink_emit(sink, m->out, m->outlen) != 0)
+		return (-1);
+	m->outlen = 0;
+
+	return (0);
+}
+
+static int
+sink_write(struct sink *sink, const char *buf, size_t len)
+{
+	if (sink->minify != NULL)
+		return (minify_write(sink, buf, len));
+
+	return (sink_emit(sink, buf, len));
+}
+
+static NEOERR *
+cplanet_output(void *ctx, char *s)
+{
+	if (sink_write(ctx, s, strlen(s)) != 0)
+		return (nerr_raise_errno(NERR_IO, "write"));
+
+	return (STATUS_OK);
+}
+
+/*
+ * end the compressed streams and put the files in place, the copies
+ * first so that they are never older than the file, the copies no more
+ * wanted are removed
+ */
+static int
+sink_commit(struct sink *sink, const char *path, const int64_t *levels)
+{
+	struct sibling *sib;
+	char *sibpath;
+	int i, ret = 0;
+
+	if (sink->minify != NULL && minify_finish(sink) != 0)
+		ret = -1;
+	for (i = 0; i < sink->nsib; i++) {
+		sib = &sink->sib[i];
+		if (sibling_write(sib, "", 0, true) != 0)
+			ret = -1;
+		if (fclose(sib->out) != 0)
+			ret = -1;
+		sib->out = NULL;
+	}
+	if (fclose(sink->out) != 0)
+		ret = -1;
+	sink->out = NULL;
+	if (ret != 0)
+		return (-1);
+
+	for (i = 0; i < sink->nsib; i++) {
+		sib = &sink->sib[i];
+		if (asprintf(&sibpath, "%s%s", path,
+		    sibling_kinds[sib->kind].suffix) == -1)
+			return (-1);
+		ret = rename(sib->tmppath, sibpath);
+		free(sibpath);
+		if (ret == -1)
+			return (-1);
+		free(sib->tmppath);
+		sib->tmppath = NULL;
+	}
+	if (rename(sink->tmppath, path) == -1)
+		return (-1);
+	free(sink->tmppath);
+	sink->tmppath = NULL;
+
+	for (i = 0; i < SIBLING_MAX; i++) {
+		if (levels[i] != 0 && sibling_kinds[i].supported)
+			continue;
+		if (asprintf(&sibpath, "%s%s", path, sibling_kinds[i].suffix) == -1)
+			continue;
+		unlink(sibpath);
+		free(sibpath);
+	}
+
+	return (0);
+}
+
+/* drop whatever is left of the temporary files */
+static void
+sink_free(struct sink *sink)
+{
+	struct sibling *sib;
+	int i;
+
+	for (i = 0; i < sink->nsib; i++) {
+		sib = &sink->sib[i];
+		if (sib->out != NULL)
+			fclose(sib->out);
+		if (sib->tmppath != NULL) {
+			unlink(sib->tmppath);
+			free(sib->tmppath);
+		}
+		sibling_free(sib);
+	}
+	if (sink->out != NULL)
+		fclose(sink->out);
+	if (sink->tmppath != NULL) {
+		unlink(sink->tmppath);
+		free(sink->tmppath);
+	}
+	free(sink->minify);
+}
+
+/* the link_key of the home of the feed name, 0 if it has none */
+static int64_t
+feed_home_key(const unsigned char *name)
+{
+	sqlite3_stmt *stmt;
+	UT_string *canon;
+	const char *home;
+	int64_t key = 0;
+
+	if ((stmt = sql_prepare("SELECT home FROM feed WHERE name=?1;")) == NULL)
+		return (0);
+	sqlite3_bind_text(stmt, 1, (const char *)name, -1, SQLITE_STATIC);
+	if (sqlite3_step(stmt) == SQLITE_ROW &&
+	    (home = (const char *)sqlite3_column_text(stmt, 0)) != NULL) {
+		utstring_new(canon);
+		link_canonical(home, canon);
+		key = hash_buf(utstring_body(canon), utstring_len(canon));
+		utstring_free(canon);
+	}
+	sqlite3_reset(stmt);
+
+	return (key);
+}
+
+/*
+ * store the entries of the feed name found in body, url is for the messages,
+ * what was done is counted in stats; -1 when nothing could be stored, with
+ * stats->error saying why
+ */
+int
+parse_posts(const unsigned char *name, const char *body, size_t len,
+    const char *url, struct feed_stats *stats)
+{
+	struct XML_ParserStruct *parser;
+	struct feed feed;
+	struct timespec start;
+	double dbms;
+
+	/* prepared first so that a failure has nothing to release */
+	if ((feed.stmt = sql_prepare("INSERT OR REPLACE INTO posts "
+	    "(uid, name, blog_title, title, author, link, content, description, "
+	    "date, updated, tags, link_key, content_key, hash, seq) values ("
+	    "?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12, ?13, ?14, "
+	    NEXT_SEQ ");")) == NULL)
+		goto dberror;
+
+	if ((feed.dup_lookup = sql_prepare("SELECT uid FROM posts "
+	    "WHERE (link_key=?1 OR content_key=?2) AND uid IS NOT ?3 LIMIT 1;")) == NULL ||
+	    (feed.dup_insert = sql_prepare("INSERT OR REPLACE INTO duplicates "
+	    "(uid, name, post) VALUES (?1, ?2, ?3);")) == NULL ||
+	    (feed.post_delete = sql_prepare("DELETE FROM posts WHERE rowid=?1;")) == NULL ||
+	    (feed.post_touch = sql_prepare("UPDATE posts SET seq=" NEXT_SEQ
+	    " WHERE uid=?1;")) == NULL)
+		goto dberror;
+
+	/* replacing would count the tag twice in tag_stats */
+	if ((feed.tags = sql_prepare("INSERT OR IGNORE INTO tags "
+	    "(uid, tag) values (?1, ?2)")) == NULL)
+		goto dberror;
+
+	if ((feed.lookup = sql_prepare("SELECT rowid, hash FROM posts WHERE uid=?1;")) == NULL ||
+	    (feed.archive_touch = sql_prepare(ARCHIVE_TOUCH)) == NULL ||
+	    (feed.recent_delete = sql_prepare("DELETE FROM recent WHERE post=?1;")) == NULL ||
+	    (feed.recent_insert = sql_prepare("INSERT INTO recent " RECENT_SELECT
+	    "WHERE rowid=?1 AND ((SELECT count(*) FROM recent) < " MAX_POST
+	    " OR date >= (SELECT min(date) FROM recent));")) == NULL ||
+	    (feed.recent_trim = sql_prepare(RECENT_TRIM)) == NULL)
+		goto dberror;
+
+	feed.fts_delete = feed.fts_insert = NULL;
+	if (cp->has_fts && (
+	    (feed.fts_delete = sql_prepare("DELETE FROM posts_fts WHERE rowid=?1;")) == NULL ||
+	    (feed.fts_insert = sql_prepare("INSERT INTO posts_fts "
+	    "(rowid, title, author, tags, content) "
+	    "SELECT rowid, title, author, ?2, ?3 FROM posts WHERE rowid=?1;")) == NULL))
+		goto dberror;
+
+	if ((parser = XML_ParserCreate_MM(NULL, mem_counting ? &expat_mem : NULL,
+	    NULL)) == NULL) {
+		cp_warn(false, "Unable to initialise expat");
+		stats->error = "parse";
+		return (-1);
+	}
+
+	feed.type = NONE;
+	feed.name = name;
+	feed.has_author = false;
+	utstring_new(feed.blog_title);
+	utstring_new(feed.author);
+	feed.xmlpath = malloc(sizeof(struct buffer));
+	feed.xmlpath->size = 0;
+	feed.xmlpath->cap = BUFSIZ;
+	feed.xmlpath->data = malloc(BUFSIZ);
+	feed.xmlpath->data[0] = '\0';
+	utarray_new(feed.tag, &ut_str_icd);
+	utstring_new(feed.data);
+	utstring_new(feed.uid);
+	utstring_new(feed.link);
+	utstring_new(feed.content);
+	utstring_new(feed.description);
+	feed.compression = cp->cfg.compression;
+	feed.hash = HASH_INIT;
+	feed.home_key = cp->cfg.dedup ? feed_home_key(name) : 0;
+	feed.stats = stats;
+
+
+	XML_SetStartElementHandler(parser, xml_startel);
+	XML_SetEndElementHandler(parser, xml_endel);
+	XML_SetCharacterDataHandler(parser, xml_data);
+	XML_SetUserData(parser, &feed);
+
+	/* the entries are stored while parsing, that is accounted as db */
+	dbms = cp->phase_ms[PHASE_DB];
+	phase_enter(PHASE_PARSE);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (XML_Parse(parser, body, len, true) == XML_STATUS_ERROR) {
+		cp_warn(false, "Parse error at line %lu: %s for %s",
+		    XML_GetCurrentLineNumber(parser),
+		    XML_ErrorString(XML_GetErrorCode(parser)),
+		    url);
+		stats->error = "parse";
+	}
+	stats->parse = elapsed_ms(&start) - (cp->phase_ms[PHASE_DB] - dbms);
+	cp->phase_ms[PHASE_PARSE] += stats->parse;
+	TRACE_SPAN("parse", "parse", &start, "feed", (const char *)name, len);
+
+	XML_ParserFree(parser);
+	utstring_free(feed.data);
+	utstring_free(feed.uid);
+	utstring_free(feed.link);
+	utstring_free(feed.content);
+	utstring_free(feed.description);
+	utstring_free(feed.blog_title);
+	utstring_free(feed.author);
+	utarray_free(feed.tag);
+
+	free(feed.xmlpath->data);
+	free(feed.xmlpath);
+	return (0);
+
+dberror:
+	stats->error = "db";
+	return (-1);
+}
+
+/* the class of a failed transfer, as recorded in feed_stats */
+static const char *
+fetch_error(CURLcode res)
+{
+	switch (res) {
+	case CURLE_COULDNT_RESOLVE_HOST:
+	case CURLE_COULDNT_RESOLVE_PROXY:
+		return ("dns");
+	case CURLE_COULDNT_CONNECT:
+		return ("connect");
+	case CURLE_OPERATION_TIMEDOUT:
+		return ("timeout");
+	case CURLE_SSL_CONNECT_ERROR:
+	case CURLE_PEER_FAILED_VERIFICATION:
+	case CURLE_SSL_CERTPROBLEM:
+	case CURLE_SSL_CIPHER:
+	case CURLE_SSL_CACERT_BADFILE:
+		return ("tls");
+	case CURLE_HTTP_RETURNED_ERROR:
+		return ("http");
+	case CURLE_OK:
+		return ("empty");
+	default:
+		return ("fetch");
+	}
+}
+
+/* curl timings are in microseconds since the start of the request */
+static double
+curl_ms(CURL *curl, CURLINFO info)
+{
+	curl_off_t usec = 0;
+
+	curl_easy_getinfo(curl, info, &usec);
+
+	return (usec / 1000.0);
+}
+
+/* the parse and entries columns are left NULL when nothing was parsed */
+static void
+feed_stats_store(const unsigned char *name, const struct feed_stats *st,
+    bool parsed)
+{
+	sqlite3_stmt *stmt;
+	int i;
+
+	if (cp->cfg.stats_days <= 0)
+		return;
+
+	if ((stmt = sql_prepare("INSERT INTO feed_stats (name, date, dns, "
+	    "connect, tls, ttfb, total, bytes, parse, seen, inserted, skipped, "
+	    "error) VALUES (?1, strftime('%s', 'now'), ?2, ?3, ?4, ?5, ?6, ?7, "
+	    "?8, ?9, ?10, ?11, ?12);")) == NULL)
+		return;
+
+	sqlite3_bind_text(stmt, 1, (const char *)name, -1, SQLITE_STATIC);
+	sqlite3_bind_double(stmt, 2, st->dns);
+	sqlite3_bind_double(stmt, 3, st->connect);
+	sqlite3_bind_double(stmt, 4, st->tls);
+	sqlite3_bind_double(stmt, 5, st->ttfb);
+	sqlite3_bind_double(stmt, 6, st->total);
+	sqlite3_bind_int64(stmt, 7, st->bytes);
+	sqlite3_bind_double(stmt, 8, st->parse);
+	sqlite3_bind_int64(stmt, 9, st->seen);
+	sqlite3_bind_int64(stmt, 10, st->inserted);
+	sqlite3_bind_int64(stmt, 11, st->skipped);
+	for (i = 8; !parsed && i <= 11; i++)
+		sqlite3_bind_null(stmt, i);
+	sqlite3_bind_text(stmt, 12, st->error, -1, SQLITE_STATIC);
+	if (sqlite3_step(stmt) != SQLITE_DONE)
+		cp_warn(false, "sqlite: %s", sqlite3_errmsg(cp->db));
+	sqlite3_reset(stmt);
+}
+
+/* retreive posts and prepare the dataset for the template */
+static int
+fetch_posts(const unsigned char *name, const unsigned char *url)
+{
+	CURL *curl;
+	CURLcode res;
+	UT_string *rawfeed;
+	struct feed_stats st;
+	struct timespec start;
+	bool parsed;
+
+	if ((curl = curl_easy_init()) == NULL) {
+		cp_warn(false, "Unable to initialise curl");
+		return (-1);
+	}
+	memset(&st, 0, sizeof(st));
+	utstring_new(rawfeed);
+
+	curl_easy_setopt(curl, CURLOPT_URL, url);
+	curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10);
+	curl_easy_setopt(curl, CURLOPT_HEADER, 0);
+	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
+	curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1);
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_to_buffer);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, rawfeed);
+	curl_easy_setopt(curl, CURLOPT_USERAGENT, "cplanet/"CPLANET_VERSION);
+	curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "gzip");
+	curl_easy_setopt(curl, CURLOPT_TIMEOUT, 400);
+
+	phase_enter(PHASE_FETCH);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	res = curl_easy_perform(curl);
+	cp->phase_ms[PHASE_FETCH] += elapsed_ms(&start);
+	TRACE_SPAN("fetch", "fetch", &start, "feed", (const char *)name,
+	    utstring_len(rawfeed));
+
+	st.dns = curl_ms(curl, CURLINFO_NAMELOOKUP_TIME_T);
+	st.connect = curl_ms(curl, CURLINFO_CONNECT_TIME_T);
+	st.tls = curl_ms(curl, CURLINFO_APPCONNECT_TIME_T);
+	st.ttfb = curl_ms(curl, CURLINFO_STARTTRANSFER_TIME_T);
+	st.total = curl_ms(curl, CURLINFO_TOTAL_TIME_T);
+	st.bytes = utstring_len(rawfeed);
+	curl_easy_cleanup(curl);
+
+	if (res != CURLE_OK || utstring_len(rawfeed) == 0) {
+		cp_warn(false, "An error occured while fetching %s: %s", url,
+		    curl_easy_strerror(res));
+		st.error = fetch_error(res);
+		feed_stats_store(name, &st, false);
+		utstring_free(rawfeed);
+		return (0);
+	}
+
+	parsed = parse_posts(name, utstring_body(rawfeed),
+	    utstring_len(rawfeed), (const char *)url, &st) == 0;
+	feed_stats_store(name, &st, parsed);
+	utstring_free(rawfeed);
+
+	return (0);
+}
+
+/*
+ * Built-in syndication formats are written straight from the rows of the
+ * recent window, without building a dataset nor going through a template.
+ * Everything written is hashed: an unchanged feed is left in place.
+ */
+#define WRITER_BUFSIZE 65536
+
+struct writer {
+	struct sink *sink;
+	char *buf;
+	size_t len;
+	uint64_t hash;
+	int64_t items;
+	bool failed;
+};
+
+static void
+w_flush(struct writer *w)
+{
+	if (w->len > 0 && !w->failed &&
+	    sink_write(w->sink, w->buf, w->len) != 0)
+		w->failed = true;
+	w->len = 0;
+}
+
+static void
+w_write(struct writer *w, const char *s, size_t len)
+{
+	w->hash = hash_update(w->hash, s, len);
+	if (w->len + len > WRITER_BUFSIZE) {
+		w_flush(w);
+		if (len > WRITER_BUFSIZE) {
+			if (!w->failed && sink_write(w->sink, s, len) != 0)
+				w->failed = true;
+			return;
+		}
+	}
+	memcpy(w->buf + w->len, s, len);
+	w->len += len;
+}
+
+static void
+w_puts(struct writer *w, const char *s)
+{
+	w_write(w, s, strlen(s));
+}
+
+/* XML text and attribute values, control characters are not valid XML */
+static void
+w_xml(struct writer *w, const char *s)
+{
+	const char *p, *esc;
+
+	if (s == NULL)
+		return;
+	for (p = s; *p != '\0'; p++) {
+		switch (*p) {
+		case '&':
+			esc = "&amp;";
+			break;
+		case '<':
+			esc = "&lt;";
+			break;
+		case '>':
+			esc = "&gt;";
+			break;
+		case '"':
+			esc = "&quot;";
+			break;
+		case '\t':
+		case '\n':
+		case '\r':
+			continue;
+		default:
+			if ((unsigned char)*p >= 0x20)
+				continue;
+			esc = "";
+			break;
+		}
+		w_write(w, s, p - s);
+		w_puts(w, esc);
+		s = p + 1;
+	}
+	w_write(w, s, p - s);
+}
+
+/* the contents of a JSON string */
+static void
+w_jsonesc(struct writer *w, const char *s)
+{
+	const char *p, *esc;
+	char u[8];
+
+	if (s == NULL)
+		return;
+	for (p = s; *p != '\0'; p++) {
+		switch (*p) {
+		case '"':
+			esc = "\\\"";
+			break;
+		case '\\':
+			esc = "\\\\";
+			break;
+		case '\n':
+			esc = "\\n";
+			break;
+		case '\r':
+			esc = "\\r";
+			break;
+		case '\t':
+			esc = "\\t";
+			break;
+		default:
+			if ((unsigned char)*p >= 0x20)
+				continue;
+			snprintf(u, sizeof(u), "\\u%04x", (unsigned char)*p);
+			esc = u;
+			break;
+		}
+		w_write(w, s, p - s);
+		w_puts(w, esc);
+		s = p + 1;
+	}
+	w_write(w, s, p - s);
+}
+
+static void
+w_json(struct writer *w, const char *s)
+{
+	w_write(w, "\"", 1);
+	w_jsonesc(w, s);
+	w_write(w, "\"", 1);
+}
+
+/* the link of the planet to the output itself */
+static void
+w_self(struct writer *w, const char *path, bool json)
+{
+	const char *name;
+	char *self;
+
+	if ((name = strrchr(path, '/')) != NULL)
+		name++;
+	else
+		name = path;
+	if (asprintf(&self, "%s/%s", cp->cfg.url != NULL ? cp->cfg.url : "",
+	    name) == -1) {
+		w->failed = true;
+		return;
+	}
+	if (json)
+		w_json(w, self);
+	else
+		w_xml(w, self);
+	free(self);
+}
+
+static void
+atom_header(struct writer *w, const char *path, int64_t updated)
+{
+	w_puts(w, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	    "<feed xmlns=\"http://www.w3.org/2005/Atom\">\n<title type=\"text\">");
+	w_xml(w, cp->cfg.title);
+	w_puts(w, "</title>\n<subtitle type=\"text\">");
+	w_xml(w, cp->cfg.description);
+	w_puts(w, "</subtitle>\n<id>");
+	w_xml(w, cp->cfg.url);
+	w_puts(w, "/</id>\n<link rel=\"self\" type=\"application/atom+xml\" href=\"");
+	w_self(w, path, false);
+	w_puts(w, "\"/>\n<link rel=\"alternate\" type=\"text/html\" href=\"");
+	w_xml(w, cp->cfg.url);
+	w_puts(w, "\"/>\n<updated>");
+	w_puts(w, post_dates(updated, cp->cfg.date_format)->iso8601);
+	w_puts(w, "</updated>\n<author><name>");
+	w_xml(w, cp->cfg.title);
+	w_puts(w, "</name></author>\n<generator "
+	    "uri=\"http://wiki.github.com/bapt/CPlanet\" version=\""
+	    CPLANET_VERSION "\">CPlanet</generator>\n");
+}
+
+static void
+atom_entry(struct writer *w, sqlite3_stmt *stmt, const char *body,
+    sqlite3_stmt *tags)
+{
+	const char *author = (const char *)sqlite3_column_text(stmt, 3);
+	const char *link = (const char *)sqlite3_column_text(stmt, 4);
+	const char *date = post_dates(sqlite3_column_int64(stmt, 5),
+	    cp->cfg.date_format)->iso8601;
+
+	w_puts(w, "<entry>\n<title type=\"html\">");
+	w_xml(w, (const char *)sqlite3_column_text(stmt, 1));
+	w_puts(w, " &gt;&gt; ");
+	w_xml(w, (const char *)sqlite3_column_text(stmt, 2));
+	w_puts(w, "</title>\n");
+	if (author != NULL && author[0] != '\0') {
+		w_puts(w, "<author><name>");
+		w_xml(w, author);
+		w_puts(w, "</name></author>\n");
+	}
+	w_puts(w, "<content type=\"html\">");
+	w_xml(w, body);
+	w_puts(w, "</content>\n");
+	while (sqlite3_step(tags) == SQLITE_ROW) {
+		w_puts(w, "<category term=\"");
+		w_xml(w, (const char *)sqlite3_column_text(tags, 0));
+		w_puts(w, "\"/>\n");
+	}
+	w_puts(w, "<id>");
+	w_xml(w, link);
+	w_puts(w, "</id>\n<link rel=\"alternate\" href=\"");
+	w_xml(w, link);
+	w_puts(w, "\"/>\n<published>");
+	w_puts(w, date);
+	w_puts(w, "</published>\n<updated>");
+	w_puts(w, date);
+	w_puts(w, "</updated>\n</entry>\n");
+}
+
+static void
+rss_header(struct writer *w, const char *path, int64_t updated)
+{
+	w_puts(w, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	    "<rss version=\"2.0\" xmlns:atom=\"http://www.w3.org/2005/Atom\">\n"
+	    "<channel>\n<title>");
+	w_xml(w, cp->cfg.title);
+	w_puts(w, "</title>\n<link>");
+	w_xml(w, cp->cfg.url);
+	w_puts(w, "</link>\n<description>");
+	w_xml(w, cp->cfg.description);
+	w_puts(w, "</description>\n<atom:link rel=\"self\" "
+	    "type=\"application/rss+xml\" href=\"");
+	w_self(w, path, false);
+	w_puts(w, "\"/>\n<generator>CPlanet " CPLANET_VERSION
+	    "</generator>\n<lastBuildDate>");
+	w_puts(w, post_dates(updated, cp->cfg.date_format)->rfc822);
+	w_puts(w, "</lastBuildDate>\n");
+}
+
+static void
+rss_entry(struct writer *w, sqlite3_stmt *stmt, const char *body,
+    sqlite3_stmt *tags)
+{
+	const char *link = (const char *)sqlite3_column_text(stmt, 4);
+
+	w_puts(w, "<item>\n<title>");
+	w_xml(w, (const char *)sqlite3_column_text(stmt, 1));
+	w_puts(w, " &gt; ");
+	w_xml(w, (const char *)sqlite3_column_text(stmt, 2));
+	w_puts(w, "</title>\n<description>");
+	w_xml(w, body);
+	w_puts(w, "</description>\n<link>");
+	w_xml(w, link);
+	w_puts(w, "</link>\n<guid isPermaLink=\"false\">");
+	w_xml(w, link);
+	w_puts(w, "</guid>\n");
+	while (sqlite3_step(tags) == SQLITE_ROW) {
+		w_puts(w, "<category>");
+		w_xml(w, (const char *)sqlite3_column_text(tags, 0));
+		w_puts(w, "</category>\n");
+	}
+	w_puts(w, "<pubDate>");
+	w_puts(w, post_dates(sqlite3_column_int64(stmt, 5),
+	    cp->cfg.date_format)->rfc822);
+	w_puts(w, "</pubDate>\n</item>\n");
+}
+
+static void
+jsonfeed_header(struct writer *w, const char *path, int64_t updated)
+{
+	w_puts(w, "{\"version\":\"https://jsonfeed.org/version/1.1\",\"title\":");
+	w_json(w, cp->cfg.title);
+	w_puts(w, ",\"description\":");
+	w_json(w, cp->cfg.description);
+	w_puts(w, ",\"home_page_url\":");
+	w_json(w, cp->cfg.url);
+	w_puts(w, ",\"feed_url\":");
+	w_self(w, path, true);
+	/* JSON Feed has no date of its own, it goes in an extension */
+	if (updated > 0) {
+		w_puts(w, ",\"_cplanet\":{\"updated\":\"");
+		w_puts(w, post_dates(updated, cp->cfg.date_format)->iso8601);
+		w_puts(w, "\"}");
+	}
+	w_puts(w, ",\"items\":[");
+}
+
+static void
+jsonfeed_entry(struct writer *w, sqlite3_stmt *stmt, const char *body,
+    sqlite3_stmt *tags)
+{
+	const char *author = (const char *)sqlite3_column_text(stmt, 3);
+	int ntags = 0;
+
+	w_puts(w, w->items++ > 0 ? ",\n{\"id\":" : "\n{\"id\":");
+	w_json(w, (const char *)sqlite3_column_text(stmt, 8));
+	w_puts(w, ",\"url\":");
+	w_json(w, (const char *)sqlite3_column_text(stmt, 4));
+	w_puts(w, ",\"title\":\"");
+	w_jsonesc(w, (const char *)sqlite3_column_text(stmt, 1));
+	w_puts(w, " > ");
+	w_jsonesc(w, (const char *)sqlite3_column_text(stmt, 2));
+	w_puts(w, "\"");
+	w_puts(w, ",\"content_html\":");
+	w_json(w, body);
+	w_puts(w, ",\"date_published\":\"");
+	w_puts(w, post_dates(sqlite3_column_int64(stmt, 5),
+	    cp->cfg.date_format)->iso8601);
+	w_puts(w, "\"");
+	if (author != NULL && author[0] != '\0') {
+		w_puts(w, ",\"authors\":[{\"name\":");
+		w_json(w, author);
+		w_puts(w, "}]");
+	}
+	while (sqlite3_step(tags) == SQLITE_ROW) {
+		w_puts(w, ntags++ > 0 ? "," : ",\"tags\":[");
+		w_json(w, (const char *)sqlite3_column_text(tags, 0));
+	}
+	w_puts(w, ntags > 0 ? "]}" : "}");
+}
+
+static const struct out_format {
+	const char *name;
+	void (*header)(struct writer *, const char *, int64_t);
+	void (*entry)(struct writer *, sqlite3_stmt *, const char *,
+	    sqlite3_stmt *);
+	const char *footer;
+} out_formats[] = {
+	{ "atom", atom_header, atom_entry, "</feed>\n" },
+	{ "rss", rss_header, rss_entry, "</channel>\n</rss>\n" },
+	{ "jsonfeed", jsonfeed_header, jsonfeed_entry, "\n]}\n" },
+};
+
+/* the built-in format an output names as builtin:<name> */
+static const struct out_format *
+out_format_find(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(out_formats) / sizeof(out_formats[0]); i++) {
+		if (strcmp(name, out_formats[i].name) == 0)
+			return (&out_formats[i]);
+	}
+
+	return (NULL);
+}
+
+/* the query of the posts a filter selects */
+static const char *
+filter_sql(const struct filter *filter)
+{
+	return (filter_posts[(filter->feed != NULL ? 1 : 0) +
+	    (filter->tag != NULL ? 2 : 0)]);
+}
+
+static void
+sql_bind_filter(sqlite3_stmt *stmt, const struct filter *filter)
+{
+	sqlite3_bind_text(stmt, 1, filter->feed, -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 2, filter->tag, -1, SQLITE_STATIC);
+	sqlite3_bind_int64(stmt, 3, filter->limit);
+}
+
+/*
+ * write a built-in output, the file is only replaced when its hash differs
+ * from r->fingerprint which is updated
+ */
+static int
+format_render(struct render *r)
+{
+	const struct out_format *f = r->format;
+	sqlite3_stmt *stmt, *tags;
+	struct sink sink;
+	struct writer w;
+	struct timespec start;
+	UT_string *bodybuf;
+	const char *body;
+	int step, ret = -1;
+
+	if ((stmt = sql_prepare(filter_sql(&r->filter))) == NULL ||
+	    (tags = sql_prepare(POST_TAGS)) == NULL)
+		return (-1);
+	sql_bind_filter(stmt, &r->filter);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	/* the markup is escaped in the body, the minifier cannot tell it */
+	if (sink_open(&sink, r->path, r->levels, false) != 0) {
+		cp_warn(true, "%s", r->path);
+		sink_free(&sink);
+		return (-1);
+	}
+
+	memset(&w, 0, sizeof(w));
+	w.sink = &sink;
+	if ((w.buf = malloc(WRITER_BUFSIZE)) == NULL) {
+		cp_warn(true, "malloc");
+		sink_free(&sink);
+		return (-1);
+	}
+	w.hash = hash_update(HASH_INIT, (const char *)r->levels,
+	    sizeof(r->levels));
+	utstring_new(bodybuf);
+
+	/* the feed is as recent as its newest post */
+	step = sqlite3_step(stmt);
+	f->header(&w, r->path,
+	    step == SQLITE_ROW ? sqlite3_column_int64(stmt, 5) : 0);
+	for (; step == SQLITE_ROW; step = sqlite3_step(stmt)) {
+		body = sql_column_body(stmt, 7, bodybuf);
+		if (body == NULL || body[0] == '\0')
+			body = sql_column_body(stmt, 6, bodybuf);
+		sqlite3_bind_text(tags, 1,
+		    (const char *)sqlite3_column_text(stmt, 8), -1, SQLITE_STATIC);
+		f->entry(&w, stmt, body, tags);
+		sqlite3_reset(tags);
+	}
+	sqlite3_reset(stmt);
+	w_puts(&w, f->footer);
+	w_flush(&w);
+
+	if (w.failed) {
+		cp_warn(true, "%s", r->path);
+	} else if (r->fingerprint == (int64_t)w.hash) {
+		if (cp->verbose)
+			cp_info("%s: unchanged", r->path);
+		ret = 0;
+	} else if (sink_commit(&sink, r->path, r->levels) != 0) {
+		cp_warn(true, "%s", r->path);
+	} else {
+		if (cp->verbose)
+			cp_info("%s: %s written in %.3fms", r->path, f->name,
+			    elapsed_ms(&start));
+		TRACE_SPAN("render", f->name, &start, "path", r->path,
+		    sink.bytes);
+		ret = 0;
+	}
+	r->fingerprint = (int64_t)w.hash;
+
+	utstring_free(bodybuf);
+	free(w.buf);
+	sink_free(&sink);
+
+	return (ret);
+}
+
+/*
+ * write the posts changed after the cursor since as NDJSON, oldest change
+ * first and no more than limit of them unless 0. Each line carries its
+ * cursor, *cursor is set to the last one written.
+ */
+static int
+export_posts(FILE *out, int64_t since, int64_t limit, int64_t *cursor)
+{
+	sqlite3_stmt *stmt, *tags;
+	struct sink sink;
+	struct writer w;
+	struct timespec start;
+	UT_string *bodybuf;
+	const char *body, *author;
+	char num[32];
+	int64_t last = since, n = 0, updated, has_seq = 0;
+	int step = SQLITE_DONE, ntags, ret = -1;
+
+	if (sql_int(&has_seq, "SELECT count(*) FROM pragma_table_info('posts') "
+	    "WHERE name='seq';") != 0)
+		return (-1);
+	if (has_seq == 0) {
+		cp_warn(false, "%s: no change numbers yet, run an update first",
+		    cp->dbfile);
+		return (-1);
+	}
+	if ((stmt = sql_prepare(EXPORT_POSTS)) == NULL ||
+	    (tags = sql_prepare(POST_TAGS)) == NULL)
+		return (-1);
+	sqlite3_bind_int64(stmt, 1, since);
+	sqlite3_bind_int64(stmt, 2, limit > 0 ? limit : -1);
+
+	memset(&sink, 0, sizeof(sink));
+	sink.out = out;
+	memset(&w, 0, sizeof(w));
+	w.sink = &sink;
+	if ((w.buf = malloc(WRITER_BUFSIZE)) == NULL) {
+		cp_warn(true, "malloc");
+		return (-1);
+	}
+	utstring_new(bodybuf);
+
+	/* stmt holds the read lock until reset, the tags are of the same state */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (!w.failed && (step = sqlite3_step(stmt)) == SQLITE_ROW) {
+		body = sql_column_body(stmt, 9, bodybuf);
+		if (body == NULL || body[0] == '\0')
+			body = sql_column_body(stmt, 10, bodybuf);
+		author = (const char *)sqlite3_column_text(stmt, 5);
+		updated = sqlite3_column_int64(stmt, 8);
+		last = sqlite3_column_int64(stmt, 0);
+
+		snprintf(num, sizeof(num), "%" PRId64, last);
+		w_puts(&w, "{\"cursor\":");
+		w_puts(&w, num);
+		w_puts(&w, ",\"id\":");
+		w_json(&w, (const char *)sqlite3_column_text(stmt, 1));
+		w_puts(&w, ",\"feed\":");
+		w_json(&w, (const char *)sqlite3_column_text(stmt, 2));
+		w_puts(&w, ",\"feed_title\":");
+		w_json(&w, (const char *)sqlite3_column_text(stmt, 3));
+		w_puts(&w, ",\"title\":");
+		w_json(&w, (const char *)sqlite3_column_text(stmt, 4));
+		if (author != NULL && author[0] != '\0') {
+			w_puts(&w, ",\"author\":");
+			w_json(&w, author);
+		}
+		w_puts(&w, ",\"url\":");
+		w_json(&w, (const char *)sqlite3_column_text(stmt, 6));
+		w_puts(&w, ",\"date_published\":\"");
+		w_puts(&w, post_dates(sqlite3_column_int64(stmt, 7),
+		    cp->cfg.date_format)->iso8601);
+		w_puts(&w, "\"");
+		if (updated > 0) {
+			w_puts(&w, ",\"date_modified\":\"");
+			w_puts(&w, post_dates(updated, cp->cfg.date_format)->iso8601);
+			w_puts(&w, "\"");
+		}
+		w_puts(&w, ",\"content_html\":");
+		w_json(&w, body);
+		w_puts(&w, ",\"tags\":[");
+		sqlite3_bind_text(tags, 1,
+		    (const char *)sqlite3_column_text(stmt, 1), -1, SQLITE_STATIC);
+		for (ntags = 0; sqlite3_step(tags) == SQLITE_ROW; ntags++) {
+			if (ntags > 0)
+				w_puts(&w, ",");
+			w_json(&w, (const char *)sqlite3_column_text(tags, 0));
+		}
+		sqlite3_reset(tags);
+		w_puts(&w, "]}\n");
+		n++;
+	}
+	if (!w.failed && step != SQLITE_DONE)
+		cp_warn(false, "sqlite: %s", sqlite3_errmsg(cp->db));
+	sqlite3_reset(stmt);
+	w_flush(&w);
+
+	if (w.failed || fflush(out) != 0) {
+		cp_warn(true, "export");
+	} else if (step == SQLITE_DONE) {
+		if (cp->verbose)
+			cp_info("export: %" PRId64 " posts after %" PRId64
+			    " in %.3fms, cursor %" PRId64, n, since,
+			    elapsed_ms(&start), last);
+		*cursor = last;
+		ret = 0;
+	}
+
+	utstring_free(bodybuf);
+	free(w.buf);
+
+	return (ret);
+}
+
+static NEOERR *
+template_parse(const char *path, HDF *hdf, CSPARSE **parse)
+{
+	NEOERR *neoerr;
+
+	neoerr = cs_init(parse, hdf);
+	if (neoerr == STATUS_OK)
+		neoerr = cgi_register_strfuncs(*parse);
+	if (neoerr == STATUS_OK)
+		neoerr = cs_parse_file(*parse, (char *)path);
+	if (neoerr != STATUS_OK)
+		cs_destroy(parse);
+
+	return (nerr_pass(neoerr));
+}
+
+/*
+ * return the template parsed for hdf, parsing it only if new or modified;
+ * hdf has to outlive the templates
+ */
+static NEOERR *
+template_get(struct template **templates, const char *path, HDF *hdf,
+    CSPARSE **parse)
+{
+	struct template *t;
+	struct stat st;
+	NEOERR *neoerr;
+
+	if (stat(path, &st) == -1)
+		return (nerr_raise_errno(NERR_IO, "%s", path));
+
+	for (t = *templates; t != NULL; t = t->next) {
+		if (t->hdf == hdf && !strcmp(t->path, path))
+			break;
+	}
+
+	if (t != NULL && t->mtime == st.st_mtime) {
+		*parse = t->parse;
+		return (STATUS_OK);
+	}
+
+	if (t == NULL) {
+		if ((t = calloc(1, sizeof(struct template))) == NULL)
+			return (nerr_raise(NERR_NOMEM, "%s", path));
+		t->path = strdup(path);
+		t->hdf = hdf;
+		t->next = *templates;
+		*templates = t;
+	} else {
+		cs_destroy(&t->parse);
+	}
+	t->mtime = 0;
+
+	if ((neoerr = template_parse(path, hdf, &t->parse)) != STATUS_OK)
+		return (nerr_pass(neoerr));
+
+	t->mtime = st.st_mtime;
+	*parse = t->parse;
+
+	return (STATUS_OK);
+}
+
+static void
+templates_free(struct template **templates)
+{
+	struct template *t;
+
+	while ((t = *templates) != NULL) {
+		*templates = t->next;
+		cs_destroy(&t->parse);
+		free(t->path);
+		free(t);
+	}
+}
+
+/*
+ * render into temporary files next to the output and rename them in place
+ * so that readers never see a partial page
+ */
+static int
+generate_file(struct template **templates, const char *cs_output,
+    const char *cs_path, HDF *hdf, const int64_t *levels, bool minify)
+{
+	NEOERR *neoerr;
+	STRING errstr;
+	CSPARSE *parse = NULL;
+	struct sink sink;
+	struct timespec begin, start;
+	double parsetime;
+	int ret = -1;
+
+	memset(&sink, 0, sizeof(struct sink));
+	TRACE_START(&begin);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if ((neoerr = template_get(templates, cs_path, hdf, &parse)) != STATUS_OK)
+		goto warn;
+	parsetime = elapsed_ms(&start);
+
+	if (sink_open(&sink, cs_output, levels, minify) != 0) {
+		cp_warn(true, "%s", cs_output);
+		goto cleanup;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	neoerr = cs_render(parse, &sink, cplanet_output);
+	if (neoerr != STATUS_OK)
+		goto warn;
+
+	if (sink_commit(&sink, cs_output, levels) != 0) {
+		cp_warn(true, "%s", cs_output);
+		goto cleanup;
+	}
+	ret = 0;
+
+	if (cp->verbose)
+		cp_info("%s: template %s in %.3fms, rendered in %.3fms",
+		    cs_output, cs_path, parsetime, elapsed_ms(&start));
+	TRACE_SPAN("render", "generate_file", &begin, "path", cs_output,
+	    sink.bytes);
+	goto cleanup;
+
+warn:
+	string_init(&errstr);
+	nerr_error_string(neoerr, &errstr);
+	cp_warn(false, "%s", errstr.buf);
+	string_clear(&errstr);
+	nerr_ignore(&neoerr);
+cleanup:
+	sink_free(&sink);
+
+	return (ret);
+}
+
+/* empty the page dataset of the worker and copy the CPlanet tree of page in */
+static HDF *
+archive_dataset(struct worker *w, HDF *page)
+{
+	NEOERR *neoerr;
+	STRING errstr;
+
+	if (w->archive == NULL)
+		neoerr = hdf_init(&w->archive);
+	else
+		neoerr = hdf_remove_tree(w->archive, "CPlanet");
+	if (neoerr == STATUS_OK)
+		neoerr = hdf_copy(w->archive, "CPlanet",
+		    hdf_get_obj(page, "CPlanet"));
+	if (neoerr != STATUS_OK) {
+		string_init(&errstr);
+		nerr_error_string(neoerr, &errstr);
+		cp_warn(false, "hdf: %s", errstr.buf);
+		string_clear(&errstr);
+		nerr_ignore(&neoerr);
+		return (NULL);
+	}
+
+	return (w->archive);
+}
+
+static void *
+render_worker(void *arg)
+{
+	struct worker *w = arg;
+	struct renderq *q = cp->renderq;
+	struct render *r;
+	HDF *hdf;
+
+	for (;;) {
+		pthread_mutex_lock(&q->lock);
+		r = q->next < q->len ? &q->r[q->next++] : NULL;
+		pthread_mutex_unlock(&q->lock);
+		if (r == NULL)
+			break;
+		if (r->format != NULL)
+			continue;
+		/*
+		 * archive pages own a dataset built for them alone, it is
+		 * copied into one the templates are parsed once on
+		 */
+		if (r->index != 0 && (hdf = archive_dataset(w, r->hdf)) == NULL) {
+			r->ret = -1;
+			continue;
+		}
+		r->ret = generate_file(&w->templates, r->path, r->template,
+		    r->index != 0 ? hdf : r->hdf, r->levels, r->minify);
+	}
+
+	return (NULL);
+}
+
+static void *
+render_thread(void *arg)
+{
+	struct worker *w = arg;
+
+	cp = w->planet;
+	trace_tid = w - cp->workers + 1;
+
+	return (render_worker(arg));
+}
+
+/*
+ * render the queued outputs on up to njobs threads, the dataset is only
+ * read while they run
+ */
+static void
+render_outputs(void)
+{
+	long i, n;
+
+	cp->renderq->next = 0;
+	n = MIN((long)cp->renderq->len, cp->njobs);
+	if (n <= 1) {
+		render_worker(&cp->workers[0]);
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (pthread_create(&cp->workers[i].thread, NULL, render_thread,
+		    &cp->workers[i]) != 0) {
+			cp_warn(false, "pthread_create failed");
+			break;
+		}
+	}
+	/* whatever could not be handed to a thread is rendered here */
+	if (i == 0)
+		render_worker(&cp->workers[0]);
+	while (i-- > 0)
+		pthread_join(cp->workers[i].thread, NULL);
+}
+
+static void
+render_free(void)
+{
+	long i;
+
+	/* the templates are parsed on the archive dataset, freed first */
+	for (i = 0; cp->workers != NULL && i < cp->njobs; i++) {
+		templates_free(&cp->workers[i].templates);
+		hdf_destroy(&cp->workers[i].archive);
+	}
+	free(cp->workers);
+	cp->workers = NULL;
+	cp->njobs = 0;
+}
+
+/* set up jobs render threads, 0 for one per CPU */
+static int
+render_init(long jobs)
+{
+	long i, n;
+
+	if ((n = jobs) == 0 && (n = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+		n = 1;
+	render_free();
+	if ((cp->workers = calloc(n, sizeof(struct worker))) == NULL) {
+		cp_warn(true, "calloc");
+		return (-1);
+	}
+	cp->njobs = n;
+	for (i = 0; i < n; i++)
+		cp->workers[i].planet = cp;
+
+	return (0);
+}
+
+/*
+ * fingerprint of a dataset subtree, leaving out the generation dates
+ * which differ on every run
+ */
+static uint64_t
+hdf_fingerprint(HDF *node, uint64_t h)
+{
+	const char *name, *value;
+
+	for (; node != NULL; node = hdf_obj_next(node)) {
+		name = hdf_obj_name(node);
+		if (name == NULL)
+			name = "";
+		if (!strncmp(name, "GenerationDate", 14))
+			continue;
+		h = hash_update(h, name, strlen(name) + 1);
+		if ((value = hdf_obj_value(node)) != NULL)
+			h = hash_update(h, value, strlen(value) + 1);
+		h = hash_update(h, "{", 1);
+		h = hdf_fingerprint(hdf_obj_child(node), h);
+		h = hash_update(h, "}", 1);
+	}
+
+	return (h);
+}
+
+/* the compression levels of the copies from the gzip column on, then minify */
+static bool
+sql_column_levels(sqlite3_stmt *stmt, int col, int64_t *levels)
+{
+	int i;
+
+	for (i = 0; i < SIBLING_MAX; i++)
+		levels[i] = sqlite3_column_int64(stmt, col + i);
+
+	return (sqlite3_column_int64(stmt, col + SIBLING_MAX) != 0);
+}
+
+/* the max_post, feed and tag columns, max_post defaults to the config one */
+static void
+sql_column_filter(sqlite3_stmt *stmt, int col, struct filter *filter)
+{
+	const char *value;
+
+	filter->limit = sqlite3_column_int64(stmt, col);
+	if (filter->limit <= 0)
+		filter->limit = cp->cfg.max_post;
+	value = (const char *)sqlite3_column_text(stmt, col + 1);
+	filter->feed = value != NULL ? strdup(value) : NULL;
+	value = (const char *)sqlite3_column_text(stmt, col + 2);
+	filter->tag = value != NULL ? strdup(value) : NULL;
+}
+
+static void
+filter_free(struct filter *filter)
+{
+	free(filter->feed);
+	free(filter->tag);
+	memset(filter, 0, sizeof(struct filter));
+}
+
+/*
+ * what an output depends on: the dataset, its template and the copies
+ * wanted, an output whose stored fingerprint matches is left untouched
+ */
+static int64_t
+output_fingerprint(uint64_t h, const char *template, const int64_t *levels,
+    bool minify)
+{
+	struct stat st;
+
+	h = hash_update(h, template, strlen(template) + 1);
+	h = hash_update(h, (const char *)levels, SIBLING_MAX * sizeof(int64_t));
+	h = hash_update(h, (const char *)&minify, sizeof(minify));
+	if (stat(template, &st) == 0) {
+		h = hash_update(h, (const char *)&st.st_mtime, sizeof(st.st_mtime));
+		h = hash_update(h, (const char *)&st.st_size, sizeof(st.st_size));
+	}
+
+	return ((int64_t)h);
+}
+
+int
+fts_rebuild(void)
+{
+	sqlite3_stmt *stmt, *insert;
+	UT_string *bodybuf, *text;
+	const char *body;
+	int ret = EXIT_SUCCESS;
+
+	if (sqlite3_prepare_v2(cp->db, "SELECT rowid, content, description, "
+	    "(SELECT group_concat(tag, ' ') FROM tags WHERE tags.uid=posts.uid) "
+	    "FROM posts;", -1, &stmt, NULL) != SQLITE_OK) {
+		cp_warn(false, "sqlite: %s", sqlite3_errmsg(cp->db));
+		return (EXIT_FAILURE);
+	}
+
+	if (sqlite3_prepare_v2(cp->db, "INSERT INTO posts_fts "
+	    "(rowid, title, author, tags, content) "
+	    "SELECT rowid, title, author, ?2, ?3 FROM posts WHERE rowid=?1;",
+	    -1, &insert, NULL) != SQLITE_OK) {
+		cp_warn(false, "sqlite: %s", sqlite3_errmsg(cp->db));
+		sqlite3_finalize(stmt);
+		return (EXIT_FAILURE);
+	}
+
+	utstring_new(bodybuf);
+	utstring_new(text);
+
+	sql_exec("BEGIN;");
+	sql_exec("DELETE FROM posts_fts;");
+	while (sqlite3_step(stmt) == SQLITE_ROW) {
+		body = sql_column_body(stmt, 1, bodybuf);
+		if (body == NULL || body[0] == '\0')
+			body = sql_column_body(stmt, 2, bodybuf);
+		html_to_text(body, text);
+
+		sqlite3_bind_int64(insert, 1, sqlite3_column_int64(stmt, 0));
+		sqlite3_bind_text(insert, 2, (const char *)sqlite3_column_text(stmt, 3), -1, SQLITE_STATIC);
+		sqlite3_bind_text(insert, 3, utstring_body(text), -1, SQLITE_STATIC);
+		if (sqlite3_step(insert) != SQLITE_DONE) {
+			cp_warn(false, "sqlite: %s", sqlite3_errmsg(cp->db));
+			ret = EXIT_FAILURE;
+			break;
+		}
+		sqlite3_reset(insert);
+	}
+	sql_exec(ret == EXIT_SUCCESS ? "COMMIT;" : "ROLLBACK;");
+
+	utstring_free(bodybuf);
+	utstring_free(text);
+	sqlite3_finalize(stmt);
+	sqlite3_finalize(insert);
+
+	return (ret);
+}
+
+/* dbfile as db_load() or the last snapshot left it, zeroed when missing */
+static bool
+db_stat(struct stat *st)
+{
+	if (stat(cp->dbfile, st) == 0)
+		return (true);
+	memset(st, 0, sizeof(*st));
+	if (errno == ENOENT)
+		return (true);
+	cp_warn(true, "%s", cp->dbfile);
+
+	return (false);
+}
+
+/*
+ * write the in-memory database back to dbfile, through sqlite so that the
+ * file keeps its mode and owner and its readers are never given a partial
+ * copy. What other cplanet commands wrote to the file since it was loaded
+ * would be lost: the snapshot is refused then.
+ */
+static bool
+db_snapshot(void)
+{
+	sqlite3 *dst;
+	sqlite3_backup *backup;
+	struct stat st;
+	int ret;
+
+	if (!db_stat(&st))
+		return (false);
+	if (st.st_size != cp->dbstat.st_size ||
+	    st.st_mtim.tv_sec != cp->dbstat.st_mtim.tv_sec ||
+	    st.st_mtim.tv_nsec != cp->dbstat.st_mtim.tv_nsec) {
+		cp_warn(false, "%s: changed since it was loaded, not overwriting "
+		    "it; restart to pick the changes up", cp->dbfile);
+		return (false);
+	}
+
+	if (sqlite3_open(cp->dbfile, &dst) != SQLITE_OK) {
+		cp_warn(false, "%s: %s", cp->dbfile, sqlite3_errmsg(dst));
+		sqlite3_close(dst);
+		return (false);
+	}
+	sqlite3_busy_timeout(dst, DB_BUSY_TIMEOUT);
+
+	if ((backup = sqlite3_backup_init(dst, "main", cp->db, "main")) == NULL) {
+		cp_warn(false, "%s: %s", cp->dbfile, sqlite3_errmsg(dst));
+		sqlite3_close(dst);
+		return (false);
+	}
+	ret = sqlite3_backup_step(backup, -1);
+	sqlite3_backup_finish(backup);
+	if (ret != SQLITE_DONE) {
+		cp_warn(false, "%s: %s", cp->dbfile, sqlite3_errmsg(dst));
+		sqlite3_close(dst);
+		return (false);
+	}
+	sqlite3_close(dst);
+
+	return (db_stat(&cp->dbstat));
+}
+
+/*
+ * the dataset is built by fetching each list entry node once and setting its
+ * fields directly below it, the hdf_set_valuef() path formats the whole key
+ * and walks it down from the root again for every single field
+ */
+static HDF *
+hdf_node(HDF *hdf, const char *name)
+{
+	HDF *node;
+	NEOERR *neoerr;
+
+	if ((neoerr = hdf_get_node(hdf, name, &node)) != STATUS_OK) {
+		nerr_ignore(&neoerr);
+		return (NULL);
+	}
+
+	return (node);
+}
+
+static HDF *
+hdf_item(HDF *list, int pos)
+{
+	char num[16];
+
+	if (list == NULL)
+		return (NULL);
+	snprintf(num, sizeof(num), "%d", pos);
+
+	return (hdf_node(list, num));
+}
+
+/* NULL columns are left unset */
+static void
+hdf_set_column(HDF *node, const char *name, sqlite3_stmt *stmt, int col)
+{
+	const char *value;
+
+	if (node == NULL)
+		return;
+	if ((value = (const char *)sqlite3_column_text(stmt, col)) != NULL)
+		hdf_set_value(node, name, value);
+}
+
+/* fill the <pos> entry of a list of posts from a row of the ARCHIVE_SELECT columns */
+static HDF *
+hdf_set_post(HDF *posts, int pos, sqlite3_stmt *stmt, UT_string *bodybuf)
+{
+	sqlite3_stmt *stags;
+	HDF *post, *tags = NULL;
+	const struct dates *dates;
+	const char *body;
+	char num[32];
+	int64_t date;
+	int tpos = 0;
+
+	if ((post = hdf_item(posts, pos)) == NULL)
+		return (NULL);
+
+	hdf_set_column(post, "Name", stmt, 0);
+	hdf_set_column(post, "FeedName", stmt, 1);
+	hdf_set_column(post, "Title", stmt, 2);
+	hdf_set_column(post, "Author", stmt, 3);
+	hdf_set_column(post, "Link", stmt, 4);
+	date = sqlite3_column_int64(stmt, 5);
+	snprintf(num, sizeof(num), "%lld", (long long)date);
+	hdf_set_value(post, "Date", num);
+	dates = post_dates(date, cp->cfg.date_format);
+	hdf_set_value(post, "DateRFC822", dates->rfc822);
+	hdf_set_value(post, "DateISO8601", dates->iso8601);
+	hdf_set_value(post, "FormatedDate", dates->formated);
+	/* only inflate the bodies of the posts actually rendered */
+	body = sql_column_body(stmt, 7, bodybuf);
+	if (body == NULL || body[0] == '\0')
+		body = sql_column_body(stmt, 6, bodybuf);
+	if (body != NULL)
+		hdf_set_value(post, "Description", body);
+
+	if ((stags = sql_prepare(POST_TAGS)) == NULL)
+		return (post);
+
+	sqlite3_bind_text(stags, 1, (char *)sqlite3_column_text(stmt, 8), -1, SQLITE_STATIC);
+	while (sqlite3_step(stags) == SQLITE_ROW) {
+		if (tags == NULL && (tags = hdf_node(post, "Tags")) == NULL)
+			break;
+		hdf_set_column(hdf_item(tags, tpos), "Tag", stags, 0);
+		tpos++;
+	}
+
+	sqlite3_reset(stags);
+
+	return (post);
+}
+
+/* the values common to every page */
+static void
+hdf_set_planet(HDF *hdf)
+{
+	const struct dates *dates;
+
+	hdf_set_valuef(hdf, "CPlanet.Name=%s", cp->cfg.title);
+	hdf_set_valuef(hdf, "CPlanet.Description=%s", cp->cfg.description);
+	hdf_set_valuef(hdf, "CPlanet.URL=%s", cp->cfg.url);
+
+	dates = post_dates(time(NULL), cp->cfg.date_format);
+	cp_set_gen_date(hdf, dates->formated);
+	cp_set_gen_iso8601(hdf, dates->iso8601);
+	cp_set_gen_rfc822(hdf, dates->rfc822);
+
+	cp_set_version(hdf);
+}
+
+static struct render *
+render_queue(const char *path, const char *template, HDF *hdf,
+    const int64_t *levels, bool minify)
+{
+	struct render *r;
+	struct renderq *q = cp->renderq;
+
+	if ((r = realloc(q->r, (q->len + 1) * sizeof(struct render))) == NULL) {
+		cp_warn(true, "realloc");
+		return (NULL);
+	}
+	q->r = r;
+	r = &q->r[q->len++];
+	memset(r, 0, sizeof(struct render));
+	r->path = strdup(path);
+	r->template = strdup(template);
+	r->hdf = hdf;
+	memcpy(r->levels, levels, sizeof(r->levels));
+	r->minify = minify;
+	r->ret = -1;
+
+	return (r);
+}
+
+/*
+ * render the queued files and record the outcome: the fingerprint of the
+ * outputs written, the archive pages which failed are left to render again
+ */
+static void
+render_flush(void)
+{
+	sqlite3_stmt *done, *redo;
+	struct render *r;
+
+	render_outputs();
+	/* the built-in outputs read the database, they are written here */
+	for (r = cp->renderq->r; r < cp->renderq->r + cp->renderq->len; r++) {
+		if (r->format != NULL)
+			r->ret = format_render(r);
+	}
+
+	done = sql_prepare("UPDATE output SET fingerprint=?1 WHERE rowid=?2;");
+	redo = sql_prepare("UPDATE archive_index SET "
+	    "dirty=min(coalesce(dirty, ?2), ?2) WHERE rowid=?1;");
+
+	for (r = cp->renderq->r; r < cp->renderq->r + cp->renderq->len; r++) {
+		if (r->index == 0 && r->ret == 0 && done != NULL) {
+			sqlite3_bind_int64(done, 1, r->fingerprint);
+			sqlite3_bind_int64(done, 2, r->rowid);
+			if (sqlite3_step(done) != SQLITE_DONE)
+				cp_warn(false, "%s", sqlite3_errmsg(cp->db));
+			sqlite3_reset(done);
+		} else if (r->index != 0 && r->ret != 0 && redo != NULL) {
+			sqlite3_bind_int64(redo, 1, r->index);
+			sqlite3_bind_int64(redo, 2, r->since);
+			if (sqlite3_step(redo) != SQLITE_DONE)
+				cp_warn(false, "%s", sqlite3_errmsg(cp->db));
+			sqlite3_reset(redo);
+		}
+		/* archive pages own their dataset */
+		if (r->index != 0)
+			hdf_destroy(&r->hdf);
+		free(r->path);
+		free(r->template);
+		filter_free(&r->filter);
+	}
+	cp->renderq->len = 0;
+}
+
+/* path of a page: %k is replaced by the key of the list, %p by the page */
+static void
+archive_path(UT_string *out, const char *pattern, const char *key,
+    int64_t page)
+{
+	const char *p, *k;
+
+	utstring_clear(out);
+	for (p = pattern; *p != '\0'; p++) {
+		if (*p != '%' || (p[1] != 'k' && p[1] != 'p' && p[1] != '%')) {
+			utstring_bincpy(out, p, 1);
+			continue;
+		}
+		p++;
+		if (*p == 'p') {
+			utstring_printf(out, "%" PRId64, page);
+		} else if (*p == 'k') {
+			/*
+			 * keys come from the feeds, keep them to one path
+			 * component which is neither empty, . nor ..: the
+			 * leading dots become -
+			 */
+			if (*key == '\0')
+				utstring_printf(out, "-");
+			for (k = key; *k == '.'; k++)
+				utstring_printf(out, "-");
+			for (; *k != '\0'; k++) {
+				if (isalnum((unsigned char)*k) || *k == '.' ||
+				    *k == '_' || *k == '-' || (*k & 0x80))
+					utstring_printf(out, "%c",
+					    tolower((unsigned char)*k));
+				else
+					utstring_printf(out, "-");
+			}
+		} else {
+			utstring_printf(out, "%%");
+		}
+	}
+}
+
+/* set the name of the page as a link relative to the current one */
+static void
+archive_link(HDF *hdf, const char *name, const char *pattern, const char *key,
+    int64_t page)
+{
+	UT_string *path;
+	const char *base;
+
+	utstring_new(path);
+	archive_path(path, pattern, key, page);
+	if ((base = strrchr(utstring_body(path), '/')) != NULL)
+		base++;
+	else
+		base = utstring_body(path);
+	hdf_set_valuef(hdf, CP_ARCHIVE_LINK, name, base);
+	utstring_free(path);
+}
+
+/*
+ * queue the pages of one list from the first one showing a post dated
+ * since or newer, the pages past the end of the list are removed
+ */
+static void
+archive_render(const struct archive_kind *k, int64_t index, const char *key,
+    int64_t oldpages, int64_t since, const char *pattern, const char *template,
+    int64_t per_page, const int64_t *levels, bool minify, UT_string *bodybuf)
+{
+	sqlite3_stmt *stmt;
+	UT_string *path;
+	struct render *r;
+	HDF *hdf, *posts;
+	UT_string *copy;
+	int64_t total, older, pages, page, offset, limit;
+	int pos, i;
+
+	if ((stmt = sql_prepare(k->count)) == NULL)
+		return;
+	sqlite3_bind_text(stmt, 1, key, -1, SQLITE_STATIC);
+	sqlite3_bind_int64(stmt, 2, since);
+	total = older = 0;
+	if (sqlite3_step(stmt) == SQLITE_ROW) {
+		total = sqlite3_column_int64(stmt, 0);
+		older = sqlite3_column_int64(stmt, 1);
+	}
+	sqlite3_reset(stmt);
+
+	pages = (total + per_page - 1) / per_page;
+	page = older / per_page + 1;
+	/* the former last page gets a link to the next one */
+	if (oldpages != pages && oldpages > 0 && oldpages < page)
+		page = oldpages;
+
+	/* done before rendering, the pages which fail flag it back */
+	if (pages == 0)
+		sql_exec("DELETE FROM archive_index WHERE rowid=%lld;",
+		    (long long)index);
+	else
+		sql_exec("UPDATE archive_index SET pages=%lld, dirty=NULL "
+		    "WHERE rowid=%lld;", (long long)pages, (long long)index);
+
+	utstring_new(path);
+	for (; page <= pages; page++) {
+		if (hdf_init(&hdf) != STATUS_OK)
+			break;
+		hdf_set_planet(hdf);
+		cp_set_archive_kind(hdf, k->name);
+		cp_set_archive_key(hdf, key);
+		cp_set_archive_page(hdf, (long long)page);
+		if (page > 1)
+			archive_link(hdf, "Prev", pattern, key, page - 1);
+		if (page < pages)
+			archive_link(hdf, "Next", pattern, key, page + 1);
+
+		/* the page numbers go up from the oldest post */
+		offset = total - page * per_page;
+		limit = per_page;
+		if (offset < 0) {
+			limit += offset;
+			offset = 0;
+		}
+		if ((stmt = sql_prepare(k->posts)) == NULL) {
+			hdf_destroy(&hdf);
+			break;
+		}
+		sql_bind_config(stmt);
+		sqlite3_bind_text(stmt, 1, key, -1, SQLITE_STATIC);
+		sqlite3_bind_int64(stmt, 2, limit);
+		sqlite3_bind_int64(stmt, 3, offset);
+		archive_path(path, pattern, key, page);
+		if ((r = render_queue(utstring_body(path), template, hdf,
+		    levels, minify)) == NULL) {
+			/* left to the next update */
+			sql_exec("UPDATE archive_index SET dirty=%lld "
+			    "WHERE rowid=%lld;", (long long)since, (long long)index);
+			hdf_destroy(&hdf);
+			break;
+		}
+		r->index = index;
+		posts = hdf_node(hdf, "CPlanet.Posts");
+		pos = 0;
+		while (sqlite3_step(stmt) == SQLITE_ROW) {
+			hdf_set_post(posts, pos++, stmt, bodybuf);
+			r->since = sqlite3_column_int64(stmt, 5);
+		}
+		sqlite3_reset(stmt);
+
+		if (cp->renderq->len >= RENDER_BATCH)
+			render_flush();
+	}
+
+	utstring_new(copy);
+	for (page = pages + 1; page <= oldpages; page++) {
+		archive_path(path, pattern, key, page);
+		if (unlink(utstring_body(path)) == -1 && errno != ENOENT)
+			cp_warn(true, "%s", utstring_body(path));
+		for (i = 0; i < SIBLING_MAX; i++) {
+			utstring_clear(copy);
+			utstring_printf(copy, "%s%s", utstring_body(path),
+			    sibling_kinds[i].suffix);
+			unlink(utstring_body(copy));
+		}
+	}
+	utstring_free(copy);
+	utstring_free(path);
+}
+
+/* render the archive pages showing posts stored or changed since last time */
+static void
+archive_update(bool force)
+{
+	sqlite3_stmt *stmt, *touch, *set;
+	const struct archive_kind *k;
+	struct dirty {
+		int64_t index;
+		char *key;
+		int64_t pages;
+		int64_t since;
+		char *kind;
+		char *path;
+		char *template;
+		int64_t per_page;
+		int64_t levels[SIBLING_MAX];
+		bool minify;
+	} *d = NULL, *tmp;
+	size_t len = 0, i, j;
+	int64_t fingerprint, levels[SIBLING_MAX];
+	bool minify;
+	uint64_t h;
+	UT_string *bodybuf;
+
+	/* new archives, and those whose template or settings changed */
+	h = hash_update(HASH_INIT, cp->cfg.title, strlen(cp->cfg.title) + 1);
+	h = hash_update(h, cp->cfg.description, strlen(cp->cfg.description) + 1);
+	h = hash_update(h, cp->cfg.url, strlen(cp->cfg.url) + 1);
+	h = hash_update(h, cp->cfg.date_format, strlen(cp->cfg.date_format) + 1);
+	if ((stmt = sql_prepare("SELECT rowid, template, fingerprint, "
+	    "gzip, brotli, zstd, minify FROM archive;")) == NULL ||
+	    (touch = sql_prepare(ARCHIVE_TOUCH_ALL)) == NULL ||
+	    (set = sql_prepare("UPDATE archive SET fingerprint=?2 "
+	    "WHERE rowid=?1;")) == NULL)
+		return;
+	while (sqlite3_step(stmt) == SQLITE_ROW) {
+		minify = sql_column_levels(stmt, 3, levels);
+		fingerprint = output_fingerprint(h,
+		    (const char *)sqlite3_column_text(stmt, 1), levels, minify);
+		if (!force && sqlite3_column_type(stmt, 2) != SQLITE_NULL &&
+		    sqlite3_column_int64(stmt, 2) == fingerprint)
+			continue;
+		sqlite3_bind_int64(touch, 1, sqlite3_column_int64(stmt, 0));
+		if (sqlite3_step(touch) != SQLITE_DONE)
+			cp_warn(false, "%s", sqlite3_errmsg(cp->db));
+		sqlite3_reset(touch);
+		sqlite3_bind_int64(set, 1, sqlite3_column_int64(stmt, 0));
+		sqlite3_bind_int64(set, 2, fingerprint);
+		if (sqlite3_step(set) != SQLITE_DONE)
+			cp_warn(false, "%s", sqlite3_errmsg(cp->db));
+		sqlite3_reset(set);
+	}
+	sqlite3_reset(stmt);
+
+	/* read it all first, rendering updates archive_index */
+	if ((stmt = sql_prepare("SELECT archive_index.rowid, key, pages, dirty, "
+	    "kind, path, template, per_page, gzip, brotli, zstd, minify FROM archive_index "
+	    "JOIN archive ON archive.rowid=archive_index.archive "
+	    "WHERE dirty IS NOT NULL;")) == NULL)
+		return;
+	while (sqlite3_step(stmt) == SQLITE_ROW) {
+		/* what is not read stays dirty */
+		if ((tmp = realloc(d, (len + 1) * sizeof(struct dirty))) == NULL) {
+			cp_warn(true, "realloc");
+			break;
+		}
+		d = tmp;
+		d[len].index = sqlite3_column_int64(stmt, 0);
+		d[len].key = strdup((const char *)sqlite3_column_text(stmt, 1));
+		d[len].pages = sqlite3_column_int64(stmt, 2);
+		d[len].since = sqlite3_column_int64(stmt, 3);
+		d[len].kind = strdup((const char *)sqlite3_column_text(stmt, 4));
+		d[len].path = strdup((const char *)sqlite3_column_text(stmt, 5));
+		d[len].template = strdup((const char *)sqlite3_column_text(stmt, 6));
+		d[len].per_page = sqlite3_column_int64(stmt, 7);
+		d[len].minify = sql_column_levels(stmt, 8, d[len].levels);
+		len++;
+	}
+	sqlite3_reset(stmt);
+
+	utstring_new(bodybuf);
+	for (i = 0; i < len; i++) {
+		for (j = 0; j < archive_kinds_len; j++) {
+			k = &archive_kinds[j];
+			if (!strcmp(k->name, d[i].kind) && d[i].per_page > 0)
+				archive_render(k, d[i].index, d[i].key, d[i].pages,
+				    d[i].since, d[i].path, d[i].template,
+				    d[i].per_page, d[i].levels, d[i].minify,
+				    bodybuf);
+		}
+		free(d[i].key);
+		free(d[i].kind);
+		free(d[i].path);
+		free(d[i].template);
+	}
+	render_flush();
+	utstring_free(bodybuf);
+	free(d);
+}
+
+/* whether the post a is on comes first in the order of the queries */
+static bool
+post_newer(sqlite3_stmt *a, sqlite3_stmt *b)
+{
+	int64_t da, db;
+
+	da = sqlite3_column_int64(a, 5);
+	db = sqlite3_column_int64(b, 5);
+	if (da != db)
+		return (da > db);
+
+	return (strcmp((const char *)sqlite3_column_text(a, 8),
+	    (const char *)sqlite3_column_text(b, 8)) > 0);
+}
+
+/* the query the next post of an output comes from, NULL once it has them */
+static sqlite3_stmt *
+view_cursor(struct view *v, sqlite3_stmt *scan)
+{
+	if (v->count >= v->filter.limit)
+		return (NULL);
+	if (v->stmt != NULL)
+		return (v->row ? v->stmt : NULL);
+
+	return (scan);
+}
+
+static void
+hdf_symlink(HDF *hdf, const char *src, const char *dest)
+{
+	NEOERR *neoerr;
+
+	if ((neoerr = hdf_set_symlink(hdf, src, dest)) != STATUS_OK)
+		nerr_ignore(&neoerr);
+}
+
+/*
+ * empty the datasets of the outputs but keep their nodes, which the
+ * templates of the render threads are parsed on
+ */
+static NEOERR *
+outputs_clear(void)
+{
+	HDF *node;
+	NEOERR *neoerr;
+
+	for (node = hdf_get_child(cp->dataset, "Output"); node != NULL;
+	    node = hdf_obj_next(node)) {
+		if ((neoerr = hdf_remove_tree(node, "CPlanet")) != STATUS_OK)
+			return (nerr_pass(neoerr));
+	}
+
+	return (STATUS_OK);
+}
+
+/*
+ * the dataset of the outputs rendered with a template, and the hash of the
+ * common values. The posts of the outputs which do not filter come from a
+ * single scan by date, each filtered output reads its own on the indexes,
+ * and the queries are merged by date so that a post is set once.
+ */
+int
+dataset_build(struct view *views, size_t nviews, uint64_t *h)
+{
+	sqlite3_stmt *stmt, *scan, *newest, *cur;
+	NEOERR *neoerr = STATUS_OK;
+	STRING errstr;
+	HDF *list, *node, *post;
+	UT_string *bodybuf, *uid;
+	struct view *v;
+	const char *sql = RECENT_POSTS;
+	char src[64], dest[32];
+	uint64_t ph = 0;
+	size_t i, left = 0;
+	int pos = 0, ret = 0;
+
+	if (cp->dataset == NULL)
+		neoerr = hdf_init(&cp->dataset);
+	else if ((neoerr = hdf_remove_tree(cp->dataset, "CPlanet")) == STATUS_OK &&
+	    (neoerr = hdf_remove_tree(cp->dataset, "Posts")) == STATUS_OK)
+		neoerr = outputs_clear();
+	if (neoerr != STATUS_OK) {
+		string_init(&errstr);
+		nerr_error_string(neoerr, &errstr);
+		cp_warn(false, "hdf: %s", errstr.buf);
+		string_clear(&errstr);
+		nerr_ignore(&neoerr);
+		return (-1);
+	}
+
+	hdf_set_planet(cp->dataset);
+
+	if ((stmt = sql_prepare("SELECT tag, count, last_seen FROM tag_stats "
+	    "WHERE count > 0 ORDER BY count DESC, tag LIMIT :max_tags;")) == NULL)
+		return (-1);
+	sql_bind_config(stmt);
+
+	list = hdf_node(cp->dataset, "CPlanet.Tags");
+	pos = 0;
+	while (sqlite3_step(stmt) == SQLITE_ROW) {
+		node = hdf_item(list, pos++);
+		hdf_set_column(node, "Tag", stmt, 0);
+		hdf_set_column(node, "Count", stmt, 1);
+		hdf_set_column(node, "LastSeen", stmt, 2);
+	}
+	sqlite3_reset(stmt);
+
+	if ((stmt = sql_prepare("SELECT name, home, url from feed order by name;")) == NULL)
+		return (-1);
+
+	list = hdf_node(cp->dataset, "CPlanet.Feed");
+	pos = 0;
+	while (sqlite3_step(stmt) == SQLITE_ROW) {
+		node = hdf_item(list, pos++);
+		hdf_set_column(node, "Name", stmt, 0);
+		hdf_set_column(node, "Home", stmt, 1);
+		hdf_set_column(node, "URL", stmt, 2);
+	}
+
+	sqlite3_reset(stmt);
+
+	*h = hdf_fingerprint(hdf_obj_child(hdf_get_obj(cp->dataset, "CPlanet")),
+	    HASH_INIT);
+
+	/* the recent window is enough unless an output wants more */
+	for (i = 0; i < nviews; i++) {
+		v = &views[i];
+		snprintf(src, sizeof(src), "Output.%lld", (long long)v->rowid);
+		v->hdf = hdf_node(cp->dataset, src);
+		v->posts = hdf_node(v->hdf, "CPlanet.Posts");
+		for (node = hdf_obj_child(hdf_get_obj(cp->dataset, "CPlanet"));
+		    node != NULL; node = hdf_obj_next(node)) {
+			snprintf(src, sizeof(src), "CPlanet.%s", hdf_obj_name(node));
+			hdf_symlink(v->hdf, src, src);
+		}
+		v->stmt = NULL;
+		v->row = false;
+		if (v->filter.limit <= 0)
+			continue;
+		if (v->filter.feed == NULL && v->filter.tag == NULL) {
+			if (v->filter.limit > cp->cfg.max_post)
+				sql = ALL_POSTS;
+			left++;
+			continue;
+		}
+		/* not the cached statement, two outputs may filter alike */
+		if (sqlite3_prepare_v2(cp->db, filter_sql(&v->filter), -1,
+		    &v->stmt, NULL) != SQLITE_OK) {
+			cp_warn(false, "sqlite: %s", sqlite3_errmsg(cp->db));
+			ret = -1;
+			goto cleanup;
+		}
+		sql_bind_filter(v->stmt, &v->filter);
+		v->row = sqlite3_step(v->stmt) == SQLITE_ROW;
+	}
+	if ((stmt = sql_prepare(sql)) == NULL) {
+		ret = -1;
+		goto cleanup;
+	}
+	scan = left > 0 && sqlite3_step(stmt) == SQLITE_ROW ? stmt : NULL;
+
+	utstring_new(bodybuf);
+	utstring_new(uid);
+	list = hdf_node(cp->dataset, "Posts");
+	for (;;) {
+		newest = scan;
+		for (i = 0; i < nviews; i++) {
+			v = &views[i];
+			if (v->stmt != NULL && v->row &&
+			    (newest == NULL || post_newer(v->stmt, newest)))
+				newest = v->stmt;
+		}
+		if (newest == NULL)
+			break;
+		utstring_clear(uid);
+		utstring_printf(uid, "%s", sqlite3_column_text(newest, 8));
+
+		post = NULL;
+		for (i = 0; i < nviews; i++) {
+			v = &views[i];
+			if ((cur = view_cursor(v, scan)) == NULL ||
+			    strcmp((const char *)sqlite3_column_text(cur, 8),
+			    utstring_body(uid)) != 0)
+				continue;
+			if (post == NULL) {
+				snprintf(dest, sizeof(dest), "Posts.%d", pos);
+				if ((post = hdf_set_post(list, pos++, newest,
+				    bodybuf)) == NULL)
+					break;
+				ph = hdf_fingerprint(hdf_obj_child(post), HASH_INIT);
+			}
+			snprintf(src, sizeof(src), "%lld", (long long)v->count++);
+			hdf_symlink(v->posts, src, dest);
+			v->hash = hash_update(v->hash, (const char *)&ph, sizeof(ph));
+			if (v->stmt != NULL)
+				v->row = v->count < v->filter.limit &&
+				    sqlite3_step(v->stmt) == SQLITE_ROW;
+			else if (v->count == v->filter.limit)
+				left--;
+		}
+		if (post == NULL)
+			break;
+		/* the scan stops once the outputs it feeds are full */
+		if (scan != NULL && strcmp((const char *)sqlite3_column_text(scan, 8),
+		    utstring_body(uid)) == 0 &&
+		    (left == 0 || sqlite3_step(scan) != SQLITE_ROW))
+			scan = NULL;
+	}
+	sqlite3_reset(stmt);
+	utstring_free(uid);
+	utstring_free(bodybuf);
+
+cleanup:
+	for (i = 0; i < nviews; i++) {
+		sqlite3_finalize(views[i].stmt);
+		views[i].stmt = NULL;
+	}
+
+	return (ret);
+}
+
+static int
+update_planet(bool force, bool fetch)
+{
+	sqlite3_stmt *stmt;
+	const struct out_format *format;
+	const char *path, *template;
+	int64_t count, fingerprint, levels[SIBLING_MAX];
+	bool minify;
+	uint64_t h;
+	struct render *r;
+	struct view *views = NULL, *v;
+	struct timespec begin, start;
+	size_t nviews = 0, i;
+	int ret = EXIT_SUCCESS;
+
+	memset(cp->phase_ms, 0, sizeof(cp->phase_ms));
+	TRACE_START(&begin);
+	sql_exec("BEGIN;");
+	if ((stmt = sql_prepare("SELECT name, url from feed;")) == NULL)
+		return (EXIT_FAILURE);
+
+	while (fetch && sqlite3_step(stmt) == SQLITE_ROW)
+		fetch_posts(sqlite3_column_text(stmt, 0) ,sqlite3_column_text(stmt, 1));
+
+	sqlite3_reset(stmt);
+
+	phase_enter(PHASE_DB);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	/* stats_days 0 stops recording, what was recorded is kept */
+	if (cp->cfg.stats_days > 0)
+		sql_step("DELETE FROM feed_stats WHERE "
+		    "date < strftime('%s', 'now') - :stats_days * 86400;");
+	sql_exec("DELETE from tags where uid not in (select uid from posts);");
+	sql_exec("DELETE FROM tag_stats WHERE count <= 0;");
+
+	/* follow max_post changes and posts removed from the archive */
+	sql_step(RECENT_TRIM);
+	sql_int(&count, "SELECT count(*) >= " MAX_POST " FROM recent;");
+	if (count == 0)
+		recent_refill();
+	sql_exec("COMMIT;");
+	cp->phase_ms[PHASE_DB] += elapsed_ms(&start);
+	TRACE_SPAN("db", "commit", &start, NULL, NULL, -1);
+
+	if ((stmt = sql_prepare("SELECT rowid, path, template, fingerprint, "
+	    "gzip, brotli, zstd, minify, max_post, feed, tag FROM output;")) == NULL)
+		return (EXIT_FAILURE);
+
+	while (sqlite3_step(stmt) == SQLITE_ROW) {
+		path = (const char *)sqlite3_column_text(stmt, 1);
+		template = (const char *)sqlite3_column_text(stmt, 2);
+		minify = sql_column_levels(stmt, 4, levels);
+		if (strncmp(template, BUILTIN_PREFIX, BUILTIN_PREFIXLEN) == 0) {
+			if ((format = out_format_find(template +
+			    BUILTIN_PREFIXLEN)) == NULL) {
+				cp_warn(false, "%s: unknown format %s", path, template);
+				ret = EXIT_FAILURE;
+				continue;
+			}
+			if ((r = render_queue(path, template, NULL, levels,
+			    false)) == NULL) {
+				ret = EXIT_FAILURE;
+				break;
+			}
+			r->rowid = sqlite3_column_int64(stmt, 0);
+			r->format = format;
+			sql_column_filter(stmt, 8, &r->filter);
+			/* written again unless it is there and unchanged */
+			if (!force && access(path, F_OK) == 0)
+				r->fingerprint = sqlite3_column_int64(stmt, 3);
+			continue;
+		}
+		if ((v = realloc(views, (nviews + 1) * sizeof(struct view))) == NULL) {
+			cp_warn(true, "realloc");
+			ret = EXIT_FAILURE;
+			break;
+		}
+		views = v;
+		v = &views[nviews++];
+		memset(v, 0, sizeof(struct view));
+		v->rowid = sqlite3_column_int64(stmt, 0);
+		v->path = strdup(path);
+		v->template = strdup(template);
+		memcpy(v->levels, levels, sizeof(v->levels));
+		v->minify = minify;
+		/* regenerate an output removed behind our back */
+		if (!force && sqlite3_column_type(stmt, 3) != SQLITE_NULL &&
+		    access(path, F_OK) == 0)
+			v->fingerprint = sqlite3_column_int64(stmt, 3);
+		sql_column_filter(stmt, 8, &v->filter);
+		v->hash = HASH_INIT;
+	}
+	sqlite3_reset(stmt);
+
+	phase_enter(PHASE_HDF);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (nviews > 0 && dataset_build(views, nviews, &h) != 0)
+		ret = EXIT_FAILURE;
+	cp->phase_ms[PHASE_HDF] += elapsed_ms(&start);
+	TRACE_SPAN("hdf", "dataset_build", &start, NULL, NULL, -1);
+	for (i = 0; i < nviews; i++) {
+		v = &views[i];
+		if (ret == EXIT_SUCCESS) {
+			fingerprint = output_fingerprint(hash_update(h,
+			    (const char *)&v->hash, sizeof(v->hash)),
+			    v->template, v->levels, v->minify);
+			if (v->fingerprint != fingerprint) {
+				if ((r = render_queue(v->path, v->template,
+				    v->hdf, v->levels, v->minify)) == NULL) {
+					ret = EXIT_FAILURE;
+				} else {
+					r->rowid = v->rowid;
+					r->fingerprint = fingerprint;
+				}
+			} else if (cp->verbose)
+				cp_info("%s: unchanged", v->path);
+		}
+		free(v->path);
+		free(v->template);
+		filter_free(&v->filter);
+	}
+	free(views);
+
+	phase_enter(PHASE_RENDER);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	render_flush();
+	cp->phase_ms[PHASE_RENDER] += elapsed_ms(&start);
+	TRACE_SPAN("render", "render_flush", &start, NULL, NULL, -1);
+
+	phase_enter(PHASE_ARCHIVE);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	sql_exec("BEGIN;");
+	archive_update(force);
+	sql_exec("COMMIT;");
+	cp->phase_ms[PHASE_ARCHIVE] += elapsed_ms(&start);
+	TRACE_SPAN("db", "archive_update", &start, NULL, NULL, -1);
+
+	if (cp->verbose)
+		cp_info("update: fetch %.3fms, parse %.3fms, db %.3fms, hdf %.3fms, "
+		    "render %.3fms, archive %.3fms", cp->phase_ms[PHASE_FETCH],
+		    cp->phase_ms[PHASE_PARSE], cp->phase_ms[PHASE_DB],
+		    cp->phase_ms[PHASE_HDF], cp->phase_ms[PHASE_RENDER],
+		    cp->phase_ms[PHASE_ARCHIVE]);
+
+	TRACE_SPAN("update", "update", &begin, NULL, NULL, -1);
+
+	return (ret);
+}
+
+/* add a column missing from a table created by an older cplanet */
+static int
+db_add_column(const char *table, const char *column)
+{
+	int64_t exists = 0;
+
+	if (sql_int(&exists, "SELECT count(*) FROM pragma_table_info(%Q) "
+	    "WHERE name=%Q;", table, column) != 0)
+		return (-1);
+
+	if (exists)
+		return (0);
+
+	return (sql_exec("ALTER TABLE %q ADD COLUMN %q;", table, column));
+}
+
+/*
+ * tag_stats holds the number of posts and the date of the newest post of
+ * each tag, maintained by triggers on tags so that the top tags are cheap
+ * to get. A post stored again keeps its tags rows, the trigger on posts
+ * brings their date forward.
+ */
+static bool
+db_tag_stats(void)
+{
+	int64_t exists = 0;
+
+	if (sql_int(&exists, "SELECT count(*) FROM sqlite_master "
+	    "WHERE type='trigger' AND name='tag_stats_post';") != 0)
+		return (false);
+
+	if (exists)
+		return (true);
+
+	if (sql_exec("BEGIN;"
+	    "CREATE TABLE IF NOT EXISTS tag_stats "
+	      "(tag PRIMARY KEY, count INTEGER NOT NULL DEFAULT 0, last_seen);"
+	    "CREATE INDEX IF NOT EXISTS tag_stats_count ON tag_stats (count DESC, tag);"
+	    "DROP TRIGGER IF EXISTS tag_stats_insert;"
+	    "DROP TRIGGER IF EXISTS tag_stats_delete;"
+	    "CREATE TRIGGER tag_stats_insert AFTER INSERT ON tags BEGIN "
+	      "INSERT INTO tag_stats (tag, count, last_seen) VALUES "
+	      "(NEW.tag, 1, (SELECT date FROM posts WHERE uid=NEW.uid)) "
+	      "ON CONFLICT (tag) DO UPDATE SET count=count+1, "
+	      "last_seen=max(coalesce(last_seen, 0), coalesce(excluded.last_seen, 0)); "
+	    "END;"
+	    "CREATE TRIGGER tag_stats_delete AFTER DELETE ON tags BEGIN "
+	      "UPDATE tag_stats SET count=count-1, last_seen=(SELECT max(date) "
+	      "FROM tags JOIN posts USING (uid) WHERE tags.tag=OLD.tag) "
+	      "WHERE tag=OLD.tag; "
+	    "END;"
+	    "CREATE TRIGGER tag_stats_post AFTER INSERT ON posts BEGIN "
+	      "UPDATE tag_stats SET last_seen=max(coalesce(last_seen, 0), NEW.date) "
+	      "WHERE tag IN (SELECT tag FROM tags WHERE uid=NEW.uid); "
+	    "END;"
+	    /* tags stored before the triggers existed */
+	    "DELETE FROM tag_stats;"
+	    "INSERT INTO tag_stats (tag, count, last_seen) "
+	      "SELECT tag, count(*), max(date) FROM tags "
+	      "LEFT JOIN posts ON posts.uid=tags.uid GROUP BY tag;"
+	    "COMMIT;") != 0) {
+		sql_exec("ROLLBACK;");
+		return (false);
+	}
+
+	return (true);
+}
+
+/*
+ * the built-in formats used to be named without their prefix, which could
+ * not be told from a template file of the same name: those naming no file
+ * are given the prefix
+ */
+static bool
+db_builtin_outputs(void)
+{
+	sqlite3_stmt *stmt, *update;
+	const char *template;
+	bool ret = true;
+
+	if (sqlite3_prepare_v2(cp->db, "SELECT rowid, template FROM output "
+	    "WHERE template IN ('atom', 'rss', 'jsonfeed');", -1, &stmt,
+	    NULL) != SQLITE_OK) {
+		cp_warn(false, "sqlite: %s", sqlite3_errmsg(cp->db));
+		return (false);
+	}
+	if (sqlite3_prepare_v2(cp->db, "UPDATE output SET template="
+	    "'" BUILTIN_PREFIX "' || template WHERE rowid=?1;", -1, &update,
+	    NULL) != SQLITE_OK) {
+		cp_warn(false, "sqlite: %s", sqlite3_errmsg(cp->db));
+		sqlite3_finalize(stmt);
+		return (false);
+	}
+
+	while (ret && sqlite3_step(stmt) == SQLITE_ROW) {
+		template = (const char *)sqlite3_column_text(stmt, 1);
+		if (access(template, F_OK) == 0)
+			continue;
+		sqlite3_bind_int64(update, 1, sqlite3_column_int64(stmt, 0));
+		if (sqlite3_step(update) != SQLITE_DONE) {
+			cp_warn(false, "sqlite: %s", sqlite3_errmsg(cp->db));
+			ret = false;
+		}
+		sqlite3_reset(update);
+	}
+	sqlite3_finalize(stmt);
+	sqlite3_finalize(update);
+
+	return (ret);
+}
+
+/* copy the on disk database into the in-memory one */
+static bool
+db_load(const char *dbpath)
+{
+	sqlite3 *src;
+	sqlite3_backup *backup;
+	int ret;
+
+	if (!db_stat(&cp->dbstat))
+		return (false);
+	/* nothing to load yet */
+	if (cp->dbstat.st_ino == 0)
+		return (true);
+
+	if (sqlite3_open_v2(dbpath, &src, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+		cp_warn(false, "%s: %s", dbpath, sqlite3_errmsg(src));
+		sqlite3_close(src);
+		return (false);
+	}
+
+	if ((backup = sqlite3_backup_init(cp->db, "main", src, "main")) == NULL) {
+		cp_warn(false, "%s: %s", dbpath, sqlite3_errmsg(cp->db));
+		sqlite3_close(src);
+		return (false);
+	}
+	ret = sqlite3_backup_step(backup, -1);
+	sqlite3_backup_finish(backup);
+	sqlite3_close(src);
+
+	if (ret != SQLITE_DONE) {
+		cp_warn(false, "%s: %s", dbpath, sqlite3_errmsg(cp->db));
+		return (false);
+	}
+
+	return (true);
+}
+
+static bool
+db_open(const char *dbpath)
+{
+	int64_t fts = 0;
+	int ret;
+
+	if ((cp->dbfile = strdup(dbpath)) == NULL) {
+		cp_warn(true, "strdup");
+		return (false);
+	}
+	if (sqlite3_open_v2(cp->inmemory ? ":memory:" : dbpath, &cp->db,
+	    cp->readonly && !cp->inmemory ? SQLITE_OPEN_READONLY :
+	    SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) != SQLITE_OK) {
+		cp_warn(false, "%s: %s", dbpath, sqlite3_errmsg(cp->db));
+		return (false);
+	}
+	/* an update holds the database while it commits, wait for it */
+	sqlite3_busy_timeout(cp->db, DB_BUSY_TIMEOUT);
+
+	if (cp->inmemory && !db_load(dbpath))
+		return (false);
+
+	/* the schema is left as it is, even creating it would need to write */
+	if (cp->readonly) {
+		if (sql_int(&fts, "SELECT count(*) FROM sqlite_master "
+		    "WHERE name='posts_fts';") != 0) {
+			cp_warn(false, "%s: %s", dbpath, sqlite3_errmsg(cp->db));
+			return (false);
+		}
+		cp->has_fts = fts > 0;
+		return (true);
+	}
+
+	ret = sql_exec(
+	    "CREATE TABLE IF NOT EXISTS config "
+	      "(key TEXT NOT NULL UNIQUE, "
+	      "value);"
+	    "CREATE TABLE IF NOT EXISTS feed "
+	      "(name TEXT NOT NULL UNIQUE, "
+	      "url TEXT NOT NULL UNIQUE, "
+	      "home TEXT NOT NULL UNIQUE); "
+	    "CREATE TABLE IF NOT EXISTS output "
+	      "(path UNIQUE, template, fingerprint, gzip, brotli, zstd, minify, "
+	      "max_post, feed, tag);"
+	    "CREATE TABLE IF NOT EXISTS posts "
+	      "(uid UNIQUE, name, blog_title, title, "
+	      "author, link, content, "
+	      "description, date, updated, tags, link_key, content_key, hash);"
+	    "CREATE TABLE IF NOT EXISTS tags "
+	      "(uid, tag, UNIQUE(uid, tag));"
+	    "CREATE INDEX IF NOT EXISTS posts_date ON posts (date);"
+	    "CREATE TABLE IF NOT EXISTS recent "
+	      "(post INTEGER PRIMARY KEY, date);"
+	    "CREATE INDEX IF NOT EXISTS recent_date ON recent (date);"
+	    "CREATE TRIGGER IF NOT EXISTS recent_delete AFTER DELETE ON posts "
+	      "BEGIN DELETE FROM recent WHERE post=OLD.rowid; END;"
+
+/* Popupate with default data */
+	    "INSERT OR IGNORE INTO config values "
+	      "('title', 'default');"
+	    "INSERT OR IGNORE INTO config values "
+	      "('description', 'default');"
+	    "INSERT OR IGNORE INTO config values "
+	      "('date_format', '%%d/%%m/%%Y');"
+	    "INSERT OR IGNORE INTO config values "
+	      "('max_post', 10);"
+	    "INSERT OR IGNORE INTO config values "
+	      "('url', 'http://undefined');"
+	    "INSERT OR IGNORE INTO config values "
+	      "('compression', 0);"
+	    "INSERT OR IGNORE INTO config values "
+	      "('dedup', 0);"
+	    "INSERT OR IGNORE INTO config values "
+	      "('max_tags', 20);"
+	    "INSERT OR IGNORE INTO config values "
+	      "('stats_days', 30);"
+	      );
+
+	if (ret < 0) {
+		cp_warn(false, "%s", sqlite3_errmsg(cp->db));
+		return (false);
+	}
+
+	if (db_add_column("posts", "link_key") != 0 ||
+	    db_add_column("posts", "content_key") != 0 ||
+	    db_add_column("output", "fingerprint") != 0 ||
+	    db_add_column("posts", "hash") != 0 ||
+	    db_add_column("output", "gzip") != 0 ||
+	    db_add_column("output", "brotli") != 0 ||
+	    db_add_column("output", "zstd") != 0 ||
+	    db_add_column("output", "minify") != 0 ||
+	    db_add_column("output", "max_post") != 0 ||
+	    db_add_column("output", "feed") != 0 ||
+	    db_add_column("output", "tag") != 0 ||
+	    sql_exec(
+	    "CREATE INDEX IF NOT EXISTS posts_link_key ON posts (link_key);"
+	    "CREATE INDEX IF NOT EXISTS posts_content_key ON posts (content_key);"
+	    /* the lists of the feed and tag archives */
+	    "CREATE INDEX IF NOT EXISTS posts_name ON posts (name, date);"
+	    "CREATE INDEX IF NOT EXISTS tags_tag ON tags (tag);"
+	    "CREATE TABLE IF NOT EXISTS duplicates "
+	      "(uid UNIQUE, name, post);"
+	    "CREATE TABLE IF NOT EXISTS archive "
+	      "(kind TEXT NOT NULL, path UNIQUE, template, per_page INTEGER, "
+	      "fingerprint, gzip, brotli, zstd, minify);"
+	    "CREATE TABLE IF NOT EXISTS archive_index "
+	      "(archive INTEGER NOT NULL, key TEXT NOT NULL, "
+	      "pages INTEGER NOT NULL DEFAULT 0, dirty INTEGER, "
+	      "UNIQUE(archive, key));"
+	    "CREATE TABLE IF NOT EXISTS feed_stats "
+	      "(name TEXT NOT NULL, date INTEGER NOT NULL, dns, connect, tls, "
+	      "ttfb, total, bytes, parse, seen, inserted, skipped, error);"
+	    "CREATE INDEX IF NOT EXISTS feed_stats_date ON feed_stats (date);") != 0 ||
+	    db_add_column("archive", "gzip") != 0 ||
+	    db_add_column("archive", "brotli") != 0 ||
+	    db_add_column("archive", "zstd") != 0 ||
+	    db_add_column("archive", "minify") != 0 ||
+	    db_add_column("posts", "seq") != 0 ||
+	    sql_exec(
+	    "CREATE INDEX IF NOT EXISTS posts_seq ON posts (seq);"
+	    "CREATE TABLE IF NOT EXISTS seq_removed (seq INTEGER NOT NULL);"
+	    "INSERT INTO seq_removed SELECT 0 "
+	      "WHERE NOT EXISTS (SELECT 1 FROM seq_removed);"
+	    "CREATE TRIGGER IF NOT EXISTS seq_delete AFTER DELETE ON posts "
+	      "BEGIN UPDATE seq_removed SET seq=OLD.seq WHERE seq < OLD.seq; END;"
+	    /* stored before seq existed, numbered after the others */
+	    "UPDATE posts SET seq=(SELECT coalesce(max(seq), 0) FROM posts) + "
+	      "rowid WHERE seq IS NULL;") != 0) {
+		cp_warn(false, "%s", sqlite3_errmsg(cp->db));
+		return (false);
+	}
+
+	if (!db_tag_stats() || !db_builtin_outputs())
+		return (false);
+
+	/* the full text index is optional as fts5 may not be available */
+	if (sql_int(&fts, "SELECT count(*) FROM sqlite_master "
+	    "WHERE name='posts_fts';") != 0) {
+		cp_warn(false, "%s", sqlite3_errmsg(cp->db));
+		return (false);
+	}
+	cp->has_fts = fts > 0 || sqlite3_exec(cp->db, "CREATE VIRTUAL TABLE "
+	    "posts_fts USING fts5(title, author, tags, content);", NULL, NULL,
+	    NULL) == SQLITE_OK;
+	/* the posts stored before the index existed */
+	if (cp->has_fts && fts == 0 && fts_rebuild() != EXIT_SUCCESS)
+		return (false);
+
+	return (true);
+}
+
+
+/*
+ * libcplanet.h, each call works on the planet it is given which becomes the
+ * one of the calling thread
+ */
+static void
+planet_use(struct cplanet *planet)
+{
+	cp = planet;
+	pthread_mutex_lock(&planet->lock);
+	planet->errmsg[0] = '\0';
+	pthread_mutex_unlock(&planet->lock);
+}
+
+int
+cplanet_init(int flags)
+{
+	CURLcode res;
+	mode_t mask;
+
+	if (flags & CPLANET_MEMSTATS)
+		mem_init();
+	if (sqlite3_initialize() != SQLITE_OK) {
+		warnx("Unable to initialise sqlite");
+		return (CPLANET_ERROR);
+	}
+	if (mem_counting)
+		res = curl_global_init_mem(CURL_GLOBAL_ALL, curlmem_malloc,
+		    curlmem_free, curlmem_realloc, curlmem_strdup, curlmem_calloc);
+	else
+		res = curl_global_init(CURL_GLOBAL_ALL);
+	if (res != CURLE_OK) {
+		warnx("Unable to initialise curl: %s", curl_easy_strerror(res));
+		return (CPLANET_ERROR);
+	}
+	/* neoerr registers its error types lazily, do it before the threads */
+	nerr_init();
+	/* umask(2) can only be read by changing it, not while rendering */
+	mask = umask(0);
+	umask(mask);
+	filemode = 0666 & ~mask;
+
+	return (CPLANET_OK);
+}
+
+void
+cplanet_shutdown(void)
+{
+	curl_global_cleanup();
+	sqlite3_shutdown();
+	mem_report();
+}
+
+int
+cplanet_open(const char *dbpath, int flags, struct cplanet **planetp)
+{
+	struct cplanet *planet;
+
+	if ((planet = calloc(1, sizeof(struct cplanet))) == NULL ||
+	    (planet->renderq = calloc(1, sizeof(struct renderq))) == NULL) {
+		free(planet);
+		*planetp = NULL;
+		return (CPLANET_ERROR);
+	}
+	*planetp = planet;
+	pthread_mutex_init(&planet->lock, NULL);
+	pthread_mutex_init(&planet->renderq->lock, NULL);
+	planet->inmemory = (flags & CPLANET_INMEMORY) != 0;
+	planet->verbose = (flags & CPLANET_VERBOSE) != 0;
+	planet->quiet = (flags & CPLANET_QUIET) != 0;
+	planet->readonly = (flags & CPLANET_READONLY) != 0;
+
+	planet_use(planet);
+	if (!db_open(dbpath) || !config_load() || render_init(0) != 0)
+		return (CPLANET_ERROR);
+
+	return (CPLANET_OK);
+}
+
+void
+cplanet_close(struct cplanet *planet)
+{
+	if (planet == NULL)
+		return;
+
+	planet_use(planet);
+	trace_close();
+	render_free();
+	sql_cache_free();
+	config_free();
+	hdf_destroy(&planet->dataset);
+	sqlite3_close(planet->db);
+	free(planet->dbfile);
+	free(planet->renderq->r);
+	pthread_mutex_destroy(&planet->renderq->lock);
+	free(planet->renderq);
+	pthread_mutex_destroy(&planet->lock);
+	free(planet);
+	cp = NULL;
+}
+
+const char *
+cplanet_errmsg(struct cplanet *planet)
+{
+	if (planet == NULL)
+		return ("Unable to allocate the planet");
+
+	return (planet->errmsg);
+}
+
+sqlite3 *
+cplanet_db(struct cplanet *planet)
+{
+	return (planet->db);
+}
+
+int
+cplanet_reload(struct cplanet *planet)
+{
+	planet_use(planet);
+
+	return (config_load() ? CPLANET_OK : CPLANET_ERROR);
+}
+
+int
+cplanet_snapshot(struct cplanet *planet)
+{
+	planet_use(planet);
+	if (!planet->inmemory)
+		return (CPLANET_OK);
+
+	return (db_snapshot() ? CPLANET_OK : CPLANET_ERROR);
+}
+
+int
+cplanet_jobs(struct cplanet *planet, long jobs)
+{
+	planet_use(planet);
+	if (jobs < 0) {
+		cp_warn(false, "Invalid number of jobs: %ld", jobs);
+		return (CPLANET_ERROR);
+	}
+
+	return (render_init(jobs) == 0 ? CPLANET_OK : CPLANET_ERROR);
+}
+
+int
+cplanet_trace(struct cplanet *planet, const char *path)
+{
+	planet_use(planet);
+	if (trace_close() != 0)
+		return (CPLANET_ERROR);
+	if (path != NULL && !trace_open(path))
+		return (CPLANET_ERROR);
+
+	return (CPLANET_OK);
+}
+
+int
+cplanet_update(struct cplanet *planet, int flags)
+{
+	planet_use(planet);
+	if (update_planet((flags & CPLANET_FORCE) != 0,
+	    (flags & CPLANET_NOFETCH) == 0) != EXIT_SUCCESS)
+		return (CPLANET_ERROR);
+
+	return (CPLANET_OK);
+}
+
+int
+cplanet_export(struct cplanet *planet, FILE *out, int64_t since,
+    int64_t limit, int64_t *cursor)
+{
+	planet_use(planet);
+	if (since < 0) {
+		cp_warn(false, "Invalid cursor: %" PRId64, since);
+		return (CPLANET_ERROR);
+	}
+
+	return (export_posts(out, since, limit, cursor) == 0 ? CPLANET_OK :
+	    CPLANET_ERROR);
+}
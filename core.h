@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2010, Baptiste Daroussin
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Internal interface of libcplanet, the core shared by the cplanet
+ * command and the micro-benchmarks: the database, feed parsing, dataset
+ * building and rendering. Embedders use libcplanet.h.
+ */
+
+#ifndef CORE_H
+#define CORE_H 1
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sqlite3.h>
+
+#include "cplanet.h"
+#include "libcplanet.h"
+
+/*
+ * what the core shares with the command and the benchmarks is prefixed out
+ * of the way of the embedders' own symbols, the shared library only
+ * exports the cplanet_ calls
+ */
+#define cp			cplanet__cp
+#define sibling_kinds		cplanet__sibling_kinds
+#define archive_kinds		cplanet__archive_kinds
+#define archive_kinds_len	cplanet__archive_kinds_len
+#define elapsed_ms		cplanet__elapsed_ms
+#define sql_int			cplanet__sql_int
+#define sql_exec		cplanet__sql_exec
+#define fts_rebuild		cplanet__fts_rebuild
+#define iso8601_to_time_t	cplanet__iso8601_to_time_t
+#define rfc822_to_time_t	cplanet__rfc822_to_time_t
+#define post_dates		cplanet__post_dates
+#define parse_posts		cplanet__parse_posts
+#define dataset_build		cplanet__dataset_build
+
+/* time spent in each phase of an update, reported with -v */
+enum {
+	PHASE_FETCH,
+	PHASE_PARSE,
+	PHASE_DB,
+	PHASE_HDF,
+	PHASE_RENDER,
+	PHASE_ARCHIVE,
+	PHASE_MAX
+};
+
+/* snapshot of the config table */
+struct config {
+	char *title;
+	char *description;
+	char *url;
+	char *date_format;
+	int64_t max_post;
+	int64_t compression;
+	int64_t dedup;
+	int64_t max_tags;
+	int64_t stats_days;
+};
+
+/* compressed copies written next to the rendered files */
+enum {
+	SIBLING_GZIP,
+	SIBLING_BROTLI,
+	SIBLING_ZSTD,
+	SIBLING_MAX
+};
+
+/* the template of an output in a built-in format */
+#define BUILTIN_PREFIX "builtin:"
+#define BUILTIN_PREFIXLEN (sizeof(BUILTIN_PREFIX) - 1)
+
+struct sibling_kind {
+	const char *name;	/* output option and column */
+	const char *suffix;
+	int64_t min;
+	int64_t max;
+	int64_t dflt;
+	bool supported;
+};
+
+struct archive_kind {
+	const char *name;
+	const char *count; /* posts of the list ?1, and those older than ?2 */
+	const char *posts; /* ?2 posts of the list ?1 from ?3 */
+};
+
+/* the posts an output selects */
+struct filter {
+	char *feed;		/* NULL for every feed */
+	char *tag;		/* NULL for every tag */
+	int64_t limit;
+};
+
+/*
+ * Each output rendered with a template sees its own Output.<rowid>.CPlanet
+ * tree, made of symlinks into the dataset: to the common values under
+ * CPlanet and to the posts it selected under Posts. A post wanted by several
+ * outputs is only set once.
+ */
+struct view {
+	int64_t rowid;
+	char *path;
+	char *template;
+	int64_t levels[SIBLING_MAX];
+	bool minify;
+	int64_t fingerprint;	/* as stored, 0 to render it anyway */
+	struct filter filter;
+	int64_t count;
+	HDF *hdf;
+	HDF *posts;
+	uint64_t hash;		/* of the posts it selected */
+	sqlite3_stmt *stmt;	/* its own query when it filters */
+	bool row;		/* stmt is on a post */
+};
+
+/* what an update did with a feed, recorded in feed_stats */
+struct feed_stats {
+	double dns;		/* ms from the start of the request */
+	double connect;
+	double tls;
+	double ttfb;
+	double total;
+	int64_t bytes;
+	double parse;		/* ms, storing the entries left out */
+	int64_t seen;
+	int64_t inserted;	/* new or changed */
+	int64_t skipped;	/* unchanged or duplicates */
+	const char *error;	/* class of the failure, NULL if none */
+};
+
+struct dates {
+	char rfc822[64];
+	char iso8601[48];
+	char formated[128];
+};
+
+/* a planet, everything the core works on but for the process wide setup */
+struct cplanet {
+	sqlite3 *db;
+	bool has_fts;		/* sqlite built with fts5 */
+	char *dbfile;		/* on disk database */
+	bool inmemory;		/* work on an in-memory copy of dbfile */
+	struct stat dbstat;	/* dbfile when last loaded or written */
+	bool readonly;		/* the schema is not created nor upgraded */
+	bool verbose;
+	bool quiet;		/* warnings are only kept in errmsg */
+	struct config cfg;
+	double phase_ms[PHASE_MAX];
+	struct stmt_cache *stmts;
+	HDF *dataset;		/* kept across updates, the templates are bound to it */
+	struct renderq *renderq;
+	struct worker *workers;
+	long njobs;
+	struct trace *trace;	/* NULL unless tracing */
+	pthread_mutex_t lock;	/* errmsg, set from the render threads too */
+	char errmsg[512];
+};
+
+/* the planet the calling thread works on, set by the libcplanet.h calls */
+extern _Thread_local struct cplanet *cp;
+
+extern const struct sibling_kind sibling_kinds[SIBLING_MAX];
+extern const struct archive_kind archive_kinds[];
+extern const unsigned int archive_kinds_len;
+
+double elapsed_ms(const struct timespec *start);
+
+int sql_int(int64_t *dest, const char *sql, ...);
+int sql_exec(const char *sql, ...);
+
+int fts_rebuild(void);
+
+time_t iso8601_to_time_t(const char *d);
+time_t rfc822_to_time_t(const char *s);
+const struct dates *post_dates(int64_t date, const char *format);
+
+int parse_posts(const unsigned char *name, const char *body, size_t len,
+    const char *url, struct feed_stats *stats);
+int dataset_build(struct view *views, size_t nviews, uint64_t *h);
+
+
+#endif
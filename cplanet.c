@@ -19,609 +19,330 @@
 #include <sys/param.h>
 
 #include <assert.h>
-#include <inttypes.h>
+#include <ctype.h>
+#include <getopt.h>
+#include <signal.h>
 #include <sqlite3.h>
-#include <expat.h>
-#include <curl/curl.h>
 #include <stdbool.h>
+#include <stdlib.h>
 
-#include "utstring.h"
-#include "utarray.h"
 #include "cplanet.h"
+#include "core.h"
 
-typedef enum {
-	NONE,
-	RSS,
-	ATOM,
-	UNKNOWN
-} feed_type;
-
-static STRING neoerr_str; /* neoerr to string */
+static struct cplanet *planet;
 static sqlite3 *db;
+static volatile sig_atomic_t stop = 0;
 
-struct feed {
-	const unsigned char *name;
-	UT_string *blog_title;
-	UT_string *author;
-	bool has_author;
-	UT_string *data;
-	sqlite3_stmt *stmt;
-	sqlite3_stmt *tags;
-	UT_array *tag;
-	struct buffer *xmlpath;
-	feed_type type;
-};
-
-struct buffer {
-	char *data;
-	size_t size;
-	size_t cap;
-};
-
-static int
-sql_int(int64_t *dest, const char *sql, ...)
+static void
+usage(void)
 {
-	va_list ap;
-	sqlite3_stmt *stmt = NULL;
-	const char *sql_to_exec;
-	char *sqlbuf = NULL;
-	int ret = 0;
-
-	assert(sql != NULL);
-	assert(dest != NULL);
-
-	if (strchr(sql, '%') != NULL) {
-		va_start(ap, sql);
-		sqlbuf = sqlite3_vmprintf(sql, ap);
-		va_end(ap);
-		sql_to_exec = sqlbuf;
-	} else {
-		sql_to_exec = sql;
-	}
-
-	if (sqlite3_prepare_v2(db, sql_to_exec, -1, &stmt, 0) != SQLITE_OK) {
-		warnx("sqlite: %s", sqlite3_errmsg(db));
-		ret = 1;
-		goto cleanup;
-	}
-
-	if (sqlite3_step(stmt) == SQLITE_ROW)
-		*dest = sqlite3_column_int64(stmt, 0);
-
-cleanup:
-	if (sqlbuf != NULL)
-		sqlite3_free(sqlbuf);
-	if (stmt != NULL)
-		sqlite3_finalize(stmt);
+	fprintf(stderr, "Usage cplanet [options] <command>\n\n");
+	fprintf(stderr, "Global options:\n");
+	fprintf(stderr, "\t%-20s%s\n", "-c <configfile>", "Specify the configuration file");
+	fprintf(stderr, "\t%-20s%s\n", "-d <dbfile>", "Specify the database file");
+	fprintf(stderr, "\t%-20s%s\n", "-m", "Work on an in-memory copy of the database");
+	fprintf(stderr, "\t%-20s%s\n", "-M", "Report the memory used on exit");
+	fprintf(stderr, "\t%-20s%s\n", "-v", "Be verbose\n");
+	fprintf(stderr, "Commands supported:\n");
+	fprintf(stderr, "\t%-20s%s\n", "archive", "Configure the archives");
+	fprintf(stderr, "\t%-20s%s\n", "config", "Change config settings");
+	fprintf(stderr, "\t%-20s%s\n", "export", "Export the posts changed since a cursor");
+	fprintf(stderr, "\t%-20s%s\n", "feed", "List/Manage feeds");
+	fprintf(stderr, "\t%-20s%s\n", "output", "Configure the outputs of cplanet");
+	fprintf(stderr, "\t%-20s%s\n", "search", "Search the posts");
+	fprintf(stderr, "\t%-20s%s\n", "stats", "Report the fetch and parse times of the feeds");
+	fprintf(stderr, "\t%-20s%s\n", "update", "Fetch feeds and update datbase");
 
-	return (ret);
+	exit(1);
 }
 
-static int
-sql_text(char **dest, const char *sql)
+static void
+usage_feed(void)
 {
-	sqlite3_stmt *stmt = NULL;
-	int ret = 0;
-
-	assert(sql != NULL);
-	assert(dest != NULL);
-
-	if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK) {
-		warnx("sqlite: %s (%s)", sqlite3_errmsg(db), sql);
-		ret = 1;
-		goto cleanup;
-	}
-
-	if (sqlite3_step(stmt) == SQLITE_ROW)
-		asprintf(dest, "%s", sqlite3_column_text(stmt, 0));
-
-cleanup:
-	if (stmt != NULL)
-		sqlite3_finalize(stmt);
-
-	return (ret);
+	fprintf(stderr, "Usage:\n");
+	fprintf(stderr, "%-40s%s\n", "cplanet feed", "List current feeds");
+	fprintf(stderr, "%-40s%s\n", "cplanet feed <name> <home> <url>", "");
+	exit (1);
 }
-static int
-sql_exec(const char *sql, ...)
-{
-	va_list ap;
-	const char *sql_to_exec;
-	char *sqlbuf = NULL;
-	char *errmsg;
-	int ret = -1;
-
-	assert(sql != NULL);
-	if (strchr(sql, '%') != NULL) {
-		va_start(ap, sql);
-		sqlbuf = sqlite3_vmprintf(sql, ap);
-		va_end(ap);
-		sql_to_exec = sqlbuf;
-	} else {
-		sql_to_exec = sql;
-	}
-
-	if (sqlite3_exec(db, sql_to_exec, NULL, NULL, &errmsg) != SQLITE_OK) {
-		warnx("sqlite: %s (%s)", errmsg, sql_to_exec);
-		goto cleanup;
-	}
 
+static void
+usage_config(void)
+{
+	fprintf(stderr, "Usage:\n");
+	fprintf(stderr, "%-40s%s\n", "cplanet config", "List current configuration");
+	fprintf(stderr, "%-40s%s\n", "cplanet config <key> <value>", "Assign <value> to the <key> configuration entry");
 
-	ret = 0;
-cleanup:
-	if (sqlbuf != NULL)
-		sqlite3_free(sqlbuf);
-	return (ret);
+	exit(1);
 }
 
-static size_t
-write_to_buffer(void *ptr, size_t size, size_t memb, void *data) {
-	size_t realsize = size * memb;
-	UT_string *mem = (UT_string *)data;
-
-	utstring_bincpy(mem, ptr, realsize);
+static void
+usage_update(void)
+{
+	fprintf(stderr, "Usage:\n");
+	fprintf(stderr, "%-40s%s\n", "cplanet update [-f] [-i <seconds>] [-j <jobs>] [-s <seconds>] [--trace <file>]", "");
+	fprintf(stderr, "\t%-20s%s\n", "-f", "Regenerate the outputs even if unchanged");
+	fprintf(stderr, "\t%-20s%s\n", "-i <seconds>", "Keep running and update every <seconds>");
+	fprintf(stderr, "\t%-20s%s\n", "-j <jobs>", "Render up to <jobs> outputs at once (default: number of CPUs)");
+	fprintf(stderr, "\t%-20s%s\n", "-s <seconds>", "With -m, write the database at most every <seconds>");
+	fprintf(stderr, "\t%-20s%s\n", "--trace <file>", "Write a Chrome trace of the update to <file>");
 
-	return (realsize);
+	exit(1);
 }
 
-/* convert the iso format as the RFC3339 is a subset of it */
-static time_t
-iso8601_to_time_t(const char *d)
+static void
+usage_output(void)
 {
-	struct tm date;
-	time_t t;
-	int garbage;
-	errno = 0;
-	char *s = strdup(d);
-	char *pos = strptime(s, "%FT%TZ", &date);
-	if (pos == NULL) {
-		/* Modify the last HH:MM to HHMM if necessary */
-		if (s[strlen(s) - 3] == ':' ) {
-			s[strlen(s) - 3] = s[strlen(s) - 2];
-			s[strlen(s) - 2] = s[strlen(s) - 1];
-			s[strlen(s) - 1] = '\0';
-		}
-		pos = strptime(s, "%FT%T%z", &date);
-
-	}
-	if (pos == NULL) {
-		memset(&date, 0, sizeof(date));
-		if (sscanf(s, "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ", &date.tm_year,
-					&date.tm_mon, &date.tm_mday, &date.tm_hour, &date.tm_min,
-					&date.tm_sec, &garbage) == 7) {
-			date.tm_year -= 1900;
-			date.tm_mon -= 1;
-			pos = s;
-		}
+	fprintf(stderr, "Usage:\n");
+	fprintf(stderr, "%-40s%s\n", "cplanet output", "List currently defined output");
+	fprintf(stderr, "%-40s%s\n", "cplanet output <path> <template> [<options>]", "Create a new output with a template defined as <template> and the generated files will be in <path>");
+	fprintf(stderr, "%-40s%s\n", "cplanet output <path> builtin:atom|rss|jsonfeed [<options>]", "Create a new output in one of the built-in formats");
+	fprintf(stderr, "\nOptions:\n");
+	fprintf(stderr, "\t%-20s%s\n", "gzip[=<1-9>]", "Also write <path>.gz");
+	fprintf(stderr, "\t%-20s%s\n", "brotli[=<1-11>]", "Also write <path>.br");
+	fprintf(stderr, "\t%-20s%s\n", "zstd[=<1-19>]", "Also write <path>.zst");
+	fprintf(stderr, "\t%-20s%s\n", "minify", "Collapse whitespace and strip comments, not for the built-in formats");
+	fprintf(stderr, "\t%-20s%s\n", "max_post=<n>", "Render the <n> newest posts instead of max_post");
+	fprintf(stderr, "\t%-20s%s\n", "feed=<name>", "Only the posts of the feed <name>");
+	fprintf(stderr, "\t%-20s%s\n", "tag=<tag>", "Only the posts tagged <tag>");
 
-	}
-	free(s);
-	if (pos == NULL) {
-		errno = EINVAL;
-		warnx("Convert  ISO8601 '%s' to struct tm failed", s);
-		return 0;
-	}
-	t = mktime(&date);
-	if (t == (time_t)-1) {
-		errno = EINVAL;
-		warnx("Convert struct tm (from '%s') to time_t failed", s);
-		return 0;
-	}
-	return t;
+	exit(1);
 }
 
-/* convert RFC822 to epoch time */
-static time_t
-rfc822_to_time_t(const char *s)
+static void
+usage_archive(void)
 {
-	struct tm date;
-	time_t t;
-	char *pos;
-	errno = 0;
-
-	if (s == NULL) {
-		warnx("Invalide empty date");
-		return 0;
-	}
-
-	if ((pos = strptime(s, "%a, %d %b %Y %T", &date)) == NULL) {
-		errno = EINVAL;
-		warnx("Convert RFC822 '%s' to struct tm failed", s);
+	fprintf(stderr, "Usage:\n");
+	fprintf(stderr, "%-40s%s\n", "cplanet archive", "List currently defined archives");
+	fprintf(stderr, "%-40s%s\n", "cplanet archive <kind> <path> <template> [<per_page>] [<options>]", "Create a new archive of <kind> page, feed or tag, with <per_page> posts per page (default 20) rendered with <template>. In <path>, %k is replaced by the feed or tag name and %p by the page number. The gzip, brotli, zstd and minify options are those of output");
 
-		return 0;
-	}
+	exit(1);
+}
 
-	if ((t = mktime(&date)) == -1) {
-		errno = EINVAL;
-		warnx("Convert struct tm (from '%s') to time_t failed", s);
-		return 0;
-	}
+static void
+usage_search(void)
+{
+	fprintf(stderr, "Usage:\n");
+	fprintf(stderr, "%-40s%s\n", "cplanet search [--limit N] <query>", "Search the posts matching <query>");
+	fprintf(stderr, "%-40s%s\n", "cplanet search --rebuild", "Rebuild the full text index");
+	fprintf(stderr, "%-40s%s\n", "cplanet search --optimize", "Merge the full text index segments");
 
-	return t;
+	exit(1);
 }
 
 static void
-parse_atom_el(struct feed *feed, const char *elt, const char **attr)
+usage_stats(void)
 {
-	int i;
-	bool getlink = false;
-	char *url = NULL;
-
-	if (!strcmp(feed->xmlpath->data, "/feed/entry/link")) {
-		for (i = 0; attr[i] != NULL; i++) {
-			if (!strcmp(attr[i], "rel")) {
-				i++;
-				if (!strcmp(attr[i], "alternate"))
-					getlink = true;
-			}
-			if (!strcmp(attr[i], "href")) {
-				i++;
-				url=strdup(attr[i]);
-			}
-		}
-		if (getlink && url != NULL)
-			sqlite3_bind_text(feed->stmt, 6,url, -1, SQLITE_TRANSIENT);
-		free(url);
-	}
+	fprintf(stderr, "Usage:\n");
+	fprintf(stderr, "%-40s%s\n", "cplanet stats [--feed <name>] [--since <timestamp>]", "");
+	fprintf(stderr, "\t%-20s%s\n", "--feed <name>", "Only report the runs of the feed <name>");
+	fprintf(stderr, "\t%-20s%s\n", "--since <timestamp>", "Only report the runs since <timestamp>, in seconds since the Epoch");
 
-	if (!strcmp(feed->xmlpath->data, "/feed/entry/category")) {
-		for (i = 0; attr[i] != NULL; i++) {
-			if (!strcmp(attr[i], "term")) {
-				i++;
-				utarray_push_back(feed->tag, &attr[i]);
-			}
-		}
-	}
+	exit(1);
 }
 
-static void XMLCALL
-xml_startel(void *userdata, const char *elt, const char **attr)
+static void
+usage_export(void)
 {
-	struct feed *feed = (struct feed *)userdata;
+	fprintf(stderr, "Usage:\n");
+	fprintf(stderr, "%-40s%s\n", "cplanet export [--since <cursor>] [--limit N] [--format ndjson]", "");
+	fprintf(stderr, "\t%-20s%s\n", "--since <cursor>", "Only export the posts changed after <cursor>, the one of the last line exported");
+	fprintf(stderr, "\t%-20s%s\n", "--limit N", "Export at most N posts");
+	fprintf(stderr, "\t%-20s%s\n", "--format ndjson", "One JSON object per post and line, the only format");
 
-	if (feed->xmlpath->cap <= feed->xmlpath->size + strlen(elt) + 1) {
-		feed->xmlpath->cap *= 2;
-		feed->xmlpath->data = realloc(feed->xmlpath->data, feed->xmlpath->cap);
-	}
-	strcat(feed->xmlpath->data, "/");
-	strcat(feed->xmlpath->data, elt);
-	feed->xmlpath->size += strlen(elt) + 1;
-
-	utstring_clear(feed->data);
-
-	switch (feed->type) {
-		case NONE:
-			if (!strcmp(elt, "feed"))
-				feed->type = ATOM;
-			else if (!strcmp(elt, "rss"))
-				feed->type = RSS;
-			else
-				feed->type = UNKNOWN;
-			break;
-		case ATOM:
-			parse_atom_el(feed, elt, attr);
-			break;
-		case RSS:
-		case UNKNOWN:
-			break;
-	}
+	exit(1);
 }
 
-static void XMLCALL
-xml_endel(void *userdata, const char *elt)
+/* a row of a listing, the NULL columns are left empty */
+static void
+print_row(sqlite3_stmt *stmt)
 {
-	struct feed *feed = (struct feed *)userdata;
-	char **p;
+	const char *value;
+	int i;
 
-	if (!strcmp(feed->xmlpath->data, "/feed/entry/id") ||
-	    !strcmp(feed->xmlpath->data, "/rss/channel/item/guid")) {
-		sqlite3_bind_text(feed->stmt, 1, utstring_body(feed->data), -1, SQLITE_TRANSIENT);
-		sqlite3_bind_text(feed->tags, 1, utstring_body(feed->data), -1, SQLITE_TRANSIENT);
-	}
-	if (!strcmp(feed->xmlpath->data, "/feed/entry/title") ||
-	    !strcmp(feed->xmlpath->data, "/rss/channel/item/title")) {
-		sqlite3_bind_text(feed->stmt, 4, utstring_body(feed->data), -1, SQLITE_TRANSIENT);
-	}
-	if (!strcmp(feed->xmlpath->data, "/feed/entry/author/name") ||
-	    !strcmp(feed->xmlpath->data, "/rss/channel/item/dc:creator")) {
-		feed->has_author=true;
-		sqlite3_bind_text(feed->stmt, 5, utstring_body(feed->data), -1, SQLITE_TRANSIENT);
-	}
-	if (!strcmp(feed->xmlpath->data, "/feed/entry/published"))
-		sqlite3_bind_int64(feed->stmt, 9, iso8601_to_time_t(utstring_body(feed->data)));
-	if (!strcmp(feed->xmlpath->data, "/feed/entry/updated"))
-		sqlite3_bind_int64(feed->stmt, 10, iso8601_to_time_t(utstring_body(feed->data)));
-	if (!strcmp(feed->xmlpath->data, "/rss/channel/item/pubDate")) {
-		sqlite3_bind_int64(feed->stmt, 9, rfc822_to_time_t(utstring_body(feed->data)));
-		sqlite3_bind_int64(feed->stmt, 10, rfc822_to_time_t(utstring_body(feed->data)));
-	}
-	if (!strcmp(feed->xmlpath->data, "/rss/channel/item/category"))
-		utarray_push_back(feed->tag, &utstring_body(feed->data));
-	if (!strcmp(feed->xmlpath->data, "/feed/entry/content") ||
-	    !strcmp(feed->xmlpath->data, "/rss/channel/item/content:encoded")) {
-		sqlite3_bind_text(feed->stmt, 7, utstring_body(feed->data), -1, SQLITE_TRANSIENT);
+	for (i = 0; i < sqlite3_column_count(stmt); i++) {
+		value = (const char *)sqlite3_column_text(stmt, i);
+		printf("%s%s: %s\n", i == 0 ? "- " : "  ",
+		    sqlite3_column_name(stmt, i), value != NULL ? value : "");
 	}
+}
 
-	if (!strcmp(feed->xmlpath->data, "/rss/channel/item/link")) {
-		sqlite3_bind_text(feed->stmt, 6, utstring_body(feed->data), -1, SQLITE_TRANSIENT);
-	}
+/* <kind>[=<level>] options asking for compressed copies of the files */
+static void
+parse_levels(int argc, char **argv, int64_t *levels, bool *minify)
+{
+	const struct sibling_kind *k;
+	const char *errstr, *val;
+	size_t len;
+	int i, j;
 
-	if (!strcmp(feed->xmlpath->data, "/rss/channel/item/description"))
-		sqlite3_bind_text(feed->stmt, 8, utstring_body(feed->data), -1, SQLITE_TRANSIENT);
-
-	if (!strcmp(feed->xmlpath->data, "/rss/channel/item") ||
-	    !strcmp(feed->xmlpath->data, "/feed/entry")) {
-		sqlite3_bind_text(feed->stmt, 2, (const char *)feed->name, -1, SQLITE_STATIC);
-		sqlite3_bind_text(feed->stmt, 3, utstring_body(feed->blog_title), -1, SQLITE_STATIC);
-		if (!feed->has_author)
-			sqlite3_bind_text(feed->stmt, 5, utstring_body(feed->author), -1, SQLITE_TRANSIENT);
-		if (sqlite3_step(feed->stmt) != SQLITE_DONE)
-			warnx("sqlite3: grr: %s", sqlite3_errmsg(db));
-		sqlite3_reset(feed->stmt);
-
-		p = NULL;
-		while (( p = (char **)utarray_next(feed->tag, p)) != NULL) {
-			sqlite3_bind_text(feed->tags, 2, *p, -1, SQLITE_STATIC);
-			sqlite3_step(feed->tags);
-			sqlite3_reset(feed->tags);
+	for (i = 0; i < argc; i++) {
+		if (!strcmp(argv[i], "minify")) {
+			*minify = true;
+			continue;
+		}
+		len = strcspn(argv[i], "=");
+		for (j = 0; j < SIBLING_MAX; j++) {
+			k = &sibling_kinds[j];
+			if (strlen(k->name) == len && !strncmp(k->name, argv[i], len))
+				break;
+		}
+		if (j == SIBLING_MAX)
+			errx(EXIT_FAILURE, "Unknown option '%s'", argv[i]);
+		if (!k->supported)
+			errx(EXIT_FAILURE, "%s is not supported by this build", k->name);
+		if (argv[i][len] == '\0') {
+			levels[j] = k->dflt;
+			continue;
 		}
-		utarray_clear(feed->tag);
-		feed->has_author = false;
+		val = argv[i] + len + 1;
+		levels[j] = strtonum(val, 0, k->max, &errstr);
+		if (errstr == NULL && levels[j] != 0 && levels[j] < k->min)
+			errstr = "too small";
+		if (errstr != NULL)
+			errx(EXIT_FAILURE, "Invalid %s level '%s': %s", k->name, val, errstr);
 	}
-	feed->xmlpath->size -= strlen(elt);
-	feed->xmlpath->data[feed->xmlpath->size] = '\0';
-	if (feed->xmlpath->data[feed->xmlpath->size - 1] != '/')
-		warnx("invalid xml");
-
-	feed->xmlpath->size--;
-	feed->xmlpath->data[feed->xmlpath->size] = '\0';
-}
-
-static void XMLCALL
-xml_data(void *userdata, const char *s, int len)
-{
-	struct feed *feed = (struct feed *)userdata;
-
-	if (!strcmp(feed->xmlpath->data, "/feed/title") ||
-	    !strcmp(feed->xmlpath->data, "/rss/channel/title"))
-		utstring_bincpy(feed->blog_title, s, len);
-	if (!strcmp(feed->xmlpath->data, "/feed/author/name"))
-		utstring_bincpy(feed->author, s, len);
-	utstring_bincpy(feed->data, s, len);
 }
 
-/* prepare the string to be written to the html file */
-
-static NEOERR *
-cplanet_output (void *ctx, char *s)
+static void
+sql_bind_levels(sqlite3_stmt *stmt, int col, const int64_t *levels,
+    bool minify)
 {
-	STRING *str = ctx;
-	NEOERR *neoerr;
-
-	neoerr = nerr_pass(string_append(str, s));
+	int i;
 
-	return neoerr;
+	for (i = 0; i < SIBLING_MAX; i++)
+		sqlite3_bind_int64(stmt, col + i, levels[i]);
+	sqlite3_bind_int(stmt, col + SIBLING_MAX, minify);
 }
 
-/* retreive ports and prepare the dataset for the template */
 static int
-fetch_posts(const unsigned char *name, const unsigned char *url)
+exec_output(int argc, char **argv)
 {
-	CURL *curl;
-	CURLcode res;
-	UT_string *rawfeed;
-	struct XML_ParserStruct *parser;
-	struct feed feed;
-
-	utstring_new(rawfeed);
-
-	feed.type = NONE;
-	feed.name = name;
-	feed.has_author = false;
-	utstring_new(feed.blog_title);
-	utstring_new(feed.author);
-	feed.xmlpath = malloc(sizeof(struct buffer));
-	feed.xmlpath->size = 0;
-	feed.xmlpath->cap = BUFSIZ;
-	feed.xmlpath->data = malloc(BUFSIZ);
-	feed.xmlpath->data[0] = '\0';
-	utarray_new(feed.tag, &ut_str_icd);
-	utstring_new(feed.data);
-
-	if (sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO posts "
-	    "(uid, name, blog_title, title, author, link, content, description, "
-	    "date, updated, tags) values ("
-	    "?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11);", -1, &feed.stmt, NULL) != SQLITE_OK) {
-		warnx("sqlite: %s", sqlite3_errmsg(db));
-		return (0);
-	}
+	sqlite3_stmt *stmt;
+	const char *errstr, *feed = NULL, *tag = NULL;
+	int64_t limit = 0, levels[SIBLING_MAX] = { 0 };
+	bool minify = false;
+	int i, nopts = 0;
 
-	if (sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO tags "
-	    "(uid, tag) values (?1, ?2)", -1, &feed.tags, NULL) != SQLITE_OK) {
-		warnx("sqlite: %s", sqlite3_errmsg(db));
-		return (0);
-	}
+	argc--;
+	argv++;
 
-	curl_global_init(CURL_GLOBAL_ALL);
-	if ((curl = curl_easy_init()) == NULL)
-		errx(1, "Unable to initalise curl");
-
-	curl_easy_setopt(curl, CURLOPT_URL, url);
-	curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10);
-	curl_easy_setopt(curl, CURLOPT_HEADER, 0);
-	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
-	curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1);
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_to_buffer);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, rawfeed);
-	curl_easy_setopt(curl, CURLOPT_USERAGENT, "cplanet/"CPLANET_VERSION);
-	curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "gzip");
-	curl_easy_setopt(curl, CURLOPT_TIMEOUT, 400);
-
-	res = curl_easy_perform(curl);
-
-	if (res != CURLE_OK || utstring_len(rawfeed) == 0) {
-		curl_easy_cleanup(curl);
-		warnx("An error occured while fetching %s: %s", url, curl_easy_strerror(res));
-		free(feed.xmlpath->data);
-		free(feed.xmlpath);
-		return (0);
+	if (argc == 0) {
+		if (sqlite3_prepare_v2(db,
+		  "SELECT path, template, gzip, brotli, zstd, minify, max_post, feed, tag "
+		  "FROM output ORDER by path",
+		  -1, &stmt, NULL) != SQLITE_OK) {
+			warnx("%s", sqlite3_errmsg(db));
+			return (EXIT_FAILURE);
+		}
+		while (sqlite3_step(stmt) == SQLITE_ROW)
+			print_row(stmt);
+		sqlite3_finalize(stmt);
+		return (EXIT_SUCCESS);
 	}
 
-	if ((parser = XML_ParserCreate(NULL)) == NULL)
-		errx(1, "Unable to initialise expat");
-
-	XML_SetStartElementHandler(parser, xml_startel);
-	XML_SetEndElementHandler(parser, xml_endel);
-	XML_SetCharacterDataHandler(parser, xml_data);
-	XML_SetUserData(parser, &feed);
-
-	if (XML_Parse(parser, utstring_body(rawfeed), utstring_len(rawfeed), true) == XML_STATUS_ERROR) {
-		warnx("Parse error at line %lu: %s for %s",
-		    XML_GetCurrentLineNumber(parser),
-		    XML_ErrorString(XML_GetErrorCode(parser)),
-		    url);
+	if (argc < 2) {
+		usage_output();
+		return (EXIT_FAILURE);
 	}
+	/* the filters, what is left are the options common with archive */
+	for (i = 2; i < argc; i++) {
+		if (!strncmp(argv[i], "max_post=", 9)) {
+			limit = strtonum(argv[i] + 9, 1, INT_MAX, &errstr);
+			if (errstr != NULL)
+				errx(EXIT_FAILURE, "Invalid max_post '%s': %s", argv[i] + 9, errstr);
+		} else if (!strncmp(argv[i], "feed=", 5))
+			feed = argv[i] + 5;
+		else if (!strncmp(argv[i], "tag=", 4))
+			tag = argv[i] + 4;
+		else
+			argv[2 + nopts++] = argv[i];
+	}
+	parse_levels(nopts, argv + 2, levels, &minify);
+	if (minify && !strncmp(argv[1], BUILTIN_PREFIX, BUILTIN_PREFIXLEN))
+		errx(EXIT_FAILURE, "minify does not apply to the built-in formats");
 
-	XML_ParserFree(parser);
-	utstring_free(rawfeed);
-	utstring_free(feed.data);
-	utstring_free(feed.blog_title);
-	utstring_free(feed.author);
-	sqlite3_finalize(feed.stmt);
-	sqlite3_finalize(feed.tags);
-
-	free(feed.xmlpath->data);
-	free(feed.xmlpath);
-	return (0);
-};
-
-void
-generate_file(const unsigned char *cs_output, const unsigned char *cs_path, HDF *hdf)
-{
-	NEOERR *neoerr;
-	CSPARSE *parse;
-	STRING cs_output_data;
-	string_init(&cs_output_data);
-	neoerr = cs_init(&parse, hdf);
-	if (neoerr != STATUS_OK)
-		goto warn1;
-
-	neoerr = cgi_register_strfuncs(parse);
-
-	if (neoerr != STATUS_OK)
-		goto warn0;
-
-	neoerr = cs_parse_file(parse, (char *)cs_path);
-
-	if (neoerr != STATUS_OK)
-		goto warn0;
-
-	neoerr = cs_render(parse, &cs_output_data, cplanet_output);
-
-	if (neoerr != STATUS_OK)
-		goto warn0;
-
-	FILE *output = fopen((const char *)cs_output, "w+");
-	if (output == NULL)
-		errx(1, "%s", cs_output);
-	fprintf(output, "%s", cs_output_data.buf);
-	fflush(output);
-	fclose(output);
-	cs_destroy(&parse);
-	string_clear(&cs_output_data);
-
-	return;
-
-warn0:
-	cs_destroy(&parse);
-warn1:
-	string_clear(&cs_output_data);
-	nerr_error_string(neoerr,&neoerr_str);
-	warnx("%s", neoerr_str.buf);
-}
-
-static void
-usage(void)
-{
-	fprintf(stderr, "Usage cplanet [options] <command>\n\n");
-	fprintf(stderr, "Global options:\n");
-	fprintf(stderr, "\t%-20s%s\n", "-c <configfile>", "Specify the configuration file");
-	fprintf(stderr, "\t%-20s%s\n", "-d <dbfile>", "Specify the database file\n");
-	fprintf(stderr, "Commands supported:\n");
-	fprintf(stderr, "\t%-20s%s\n", "config", "Change config settings");
-	fprintf(stderr, "\t%-20s%s\n", "feed", "List/Manage feeds");
-	fprintf(stderr, "\t%-20s%s\n", "output", "Configure the outputs of cplanet");
-	fprintf(stderr, "\t%-20s%s\n", "update", "Fetch feeds and update datbase");
-
-	exit(1);
-}
-
-static void
-usage_feed(void)
-{
-	fprintf(stderr, "Usage:\n");
-	fprintf(stderr, "%-40s%s\n", "cplanet feed", "List current feeds");
-	fprintf(stderr, "%-40s%s\n", "cplanet feed <name> <home> <url>", "");
-	exit (1);
-}
-
-static void
-usage_config(void)
-{
-	fprintf(stderr, "Usage:\n");
-	fprintf(stderr, "%-40s%s\n", "cplanet config", "List current configuration");
-	fprintf(stderr, "%-40s%s\n", "cplanet config <key> <value>", "Assign <value> to the <key> configuration entry");
-
-	exit(1);
-}
-
-static void
-usage_update(void)
-{
-	fprintf(stderr, "Usage:\n");
-	fprintf(stderr, "%-40s%s\n", "cplanet update", "");
+	if (sqlite3_prepare_v2(db,
+	  "REPLACE INTO output (path, template, gzip, brotli, zstd, minify, "
+	  "max_post, feed, tag) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9);",
+	  -1, &stmt, NULL) != SQLITE_OK) {
+		warnx("%s", sqlite3_errmsg(db));
+		return (EXIT_FAILURE);
+	}
 
-	exit(1);
-}
+	sqlite3_bind_text(stmt, 1, argv[0], -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 2, argv[1], -1, SQLITE_STATIC);
+	sql_bind_levels(stmt, 3, levels, minify);
+	if (limit > 0)
+		sqlite3_bind_int64(stmt, 7, limit);
+	sqlite3_bind_text(stmt, 8, feed, -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 9, tag, -1, SQLITE_STATIC);
 
-static void
-usage_output(void)
-{
-	fprintf(stderr, "Usage:\n");
-	fprintf(stderr, "%-40s%s\n", "cplanet output", "List currently defined output");
-	fprintf(stderr, "%-40s%s\n", "cplanet output <path> <template>", "Create a new output with a template defined as <template> and the generated files will be in <path>");
+	sqlite3_step(stmt);
+	sqlite3_finalize(stmt);
 
-	exit(1);
+	return (EXIT_SUCCESS);
 }
 
 static int
-exec_output(int argc, char **argv)
+exec_archive(int argc, char **argv)
 {
 	sqlite3_stmt *stmt;
-	int i;
+	const char *errstr;
+	int64_t per_page = 20, levels[SIBLING_MAX] = { 0 };
+	bool minify = false;
+	unsigned int i;
+
+	argc--;
+	argv++;
 
 	if (argc == 0) {
 		if (sqlite3_prepare_v2(db,
-		  "SELECT path, template FROM output ORDER by path",
+		  "SELECT path, kind, template, per_page, gzip, brotli, zstd, minify "
+		  "FROM archive ORDER by path",
 		  -1, &stmt, NULL) != SQLITE_OK) {
 			warnx("%s", sqlite3_errmsg(db));
 			return (EXIT_FAILURE);
 		}
-		while (sqlite3_step(stmt) == SQLITE_ROW) {
-			for (i = 0; i < sqlite3_column_count(stmt); i++) {
-				printf("%s%s: %s\n", i == 0 ? "- " : "  ", sqlite3_column_name(stmt, i), sqlite3_column_text(stmt, i));
-			}
-		}
+		while (sqlite3_step(stmt) == SQLITE_ROW)
+			print_row(stmt);
 		sqlite3_finalize(stmt);
 		return (EXIT_SUCCESS);
 	}
 
-	if (argc != 2) {
-		usage_output();
+	if (argc < 3) {
+		usage_archive();
 		return (EXIT_FAILURE);
 	}
 
+	for (i = 0; i < archive_kinds_len; i++) {
+		if (!strcmp(archive_kinds[i].name, argv[0]))
+			break;
+	}
+	if (i == archive_kinds_len)
+		errx(EXIT_FAILURE, "Unknown archive kind '%s'", argv[0]);
+
+	if (argc >= 4 && isdigit((unsigned char)argv[3][0])) {
+		per_page = strtonum(argv[3], 1, INT_MAX, &errstr);
+		if (errstr != NULL)
+			errx(EXIT_FAILURE, "Invalid number of posts per page '%s': %s", argv[3], errstr);
+		parse_levels(argc - 4, argv + 4, levels, &minify);
+	} else
+		parse_levels(argc - 3, argv + 3, levels, &minify);
+
+	/* the lists of another kind do not apply anymore */
+	if (sql_exec("DELETE FROM archive_index WHERE archive IN "
+	    "(SELECT rowid FROM archive WHERE path=%Q AND kind IS NOT %Q);",
+	    argv[1], argv[0]) != 0)
+		return (EXIT_FAILURE);
+
+	/* keep the number of pages to remove those past the new end */
 	if (sqlite3_prepare_v2(db,
-	  "REPLACE INTO output VALUES (?1, ?2);",
+	  "INSERT INTO archive (kind, path, template, per_page, gzip, brotli, zstd, minify) "
+	  "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8) ON CONFLICT (path) DO UPDATE SET "
+	  "kind=excluded.kind, template=excluded.template, "
+	  "per_page=excluded.per_page, gzip=excluded.gzip, "
+	  "brotli=excluded.brotli, zstd=excluded.zstd, "
+	  "minify=excluded.minify, fingerprint=NULL;",
 	  -1, &stmt, NULL) != SQLITE_OK) {
 		warnx("%s", sqlite3_errmsg(db));
 		return (EXIT_FAILURE);
@@ -629,6 +350,9 @@ exec_output(int argc, char **argv)
 
 	sqlite3_bind_text(stmt, 1, argv[0], -1, SQLITE_STATIC);
 	sqlite3_bind_text(stmt, 2, argv[1], -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 3, argv[2], -1, SQLITE_STATIC);
+	sqlite3_bind_int64(stmt, 4, per_page);
+	sql_bind_levels(stmt, 5, levels, minify);
 
 	sqlite3_step(stmt);
 	sqlite3_finalize(stmt);
@@ -640,7 +364,9 @@ static int
 exec_feed(int argc, char **argv)
 {
 	sqlite3_stmt *stmt;
-	int i;
+
+	argc--;
+	argv++;
 
 	if (argc == 0) {
 		if (sqlite3_prepare_v2(db,
@@ -649,11 +375,8 @@ exec_feed(int argc, char **argv)
 			warnx("%s", sqlite3_errmsg(db));
 			return (EXIT_FAILURE);
 		}
-		while (sqlite3_step(stmt) == SQLITE_ROW) {
-			for (i = 0; i < sqlite3_column_count(stmt); i++) {
-				printf("%s%s: %s\n", i == 0 ? "- " : "  ", sqlite3_column_name(stmt, i), sqlite3_column_text(stmt, i));
-			}
-		}
+		while (sqlite3_step(stmt) == SQLITE_ROW)
+			print_row(stmt);
 		sqlite3_finalize(stmt);
 		return (EXIT_SUCCESS);
 	}
@@ -688,6 +411,9 @@ exec_config(int argc, char **argv)
 	int64_t integer;
 	const char *errstr;
 
+	argc--;
+	argv++;
+
 	if (argc == 0) {
 		if (sqlite3_prepare_v2(db,
 		  "SELECT key, value FROM config",
@@ -743,146 +469,418 @@ exec_config(int argc, char **argv)
 }
 
 static int
-exec_update(int argc, char **argv)
+exec_search(int argc, char **argv)
 {
-	sqlite3_stmt *stmt, *stmt2;
-	int pos = 0, tpos = 0;
-	NEOERR *neoerr;
-	HDF *hdf;
-	char *val;
-
-	sql_exec("BEGIN;");
-	if (sqlite3_prepare_v2(db, "SELECT name, url from feed;",
-	    -1, &stmt, 0) != SQLITE_OK) {
-		warnx("sqlite: %s", sqlite3_errmsg(db));
-		return (EXIT_FAILURE);
-	}
-
-	while (sqlite3_step(stmt) == SQLITE_ROW)
-		fetch_posts(sqlite3_column_text(stmt, 0) ,sqlite3_column_text(stmt, 1));
+	sqlite3_stmt *stmt;
+	int ch;
+	int64_t limit = 20;
+	const char *errstr;
+	bool rebuild = false, optimize = false;
 
-	sqlite3_finalize(stmt);
+	struct option longopts[] = {
+		{ "limit",	required_argument,	NULL,	'l' },
+		{ "optimize",	no_argument,		NULL,	'o' },
+		{ "rebuild",	no_argument,		NULL,	'r' },
+		{ NULL,		0,			NULL,	0 },
+	};
 
-	sql_exec("DELETE from tags where uid not in (select uid from posts);");
-	sql_exec("COMMIT;");
-
-	if (sqlite3_prepare_v2(db, "SELECT "
-	    "name, "
-	    "blog_title, "
-	    "title, "
-	    "author, "
-	    "link, "
-	    "date, "
-	    "strftime('%a, %d %b %Y %H:%M:%S %z', date, 'unixepoch') as rfc822, "
-	    "strftime('%Y-%m-%dT%H:%M:%SZ', date, 'unixepoch') as iso8601, "
-	    "strftime((select value from config where key='date_format'), date, 'unixepoch'), "
-	    "description, "
-	    "content, "
-	    "uid "
-	    "from posts config order by date DESC LIMIT (SELECT value from config where key='max_post');",
-	    -1, &stmt, 0) != SQLITE_OK) {
-		warnx("sqlite: %s", sqlite3_errmsg(db));
-		return (EXIT_FAILURE);
+	while ((ch = getopt_long(argc, argv, "l:or", longopts, NULL)) != -1) {
+		switch (ch) {
+		case 'l':
+			limit = strtonum(optarg, 1, INT64_MAX, &errstr);
+			if (errstr != NULL) {
+				warnx("Invalid limit '%s': %s", optarg, errstr);
+				return (EXIT_FAILURE);
+			}
+			break;
+		case 'o':
+			optimize = true;
+			break;
+		case 'r':
+			rebuild = true;
+			break;
+		default:
+			usage_search();
+		}
 	}
+	argc -= optind;
+	argv += optind;
 
-	string_init(&neoerr_str);
-	neoerr = hdf_init(&hdf);
-	if (neoerr != STATUS_OK) {
-		nerr_error_string(neoerr, &neoerr_str);
-		warnx("hdf: %s", neoerr_str.buf);
+	if (!planet->has_fts) {
+		warnx("sqlite has been built without fts5, search is not available");
 		return (EXIT_FAILURE);
 	}
 
-	while (sqlite3_step(stmt) == SQLITE_ROW) {
-		cp_set_name(hdf, pos, sqlite3_column_text(stmt, 0));
-		cp_set_feedname(hdf, pos, sqlite3_column_text(stmt, 1));
-		cp_set_title(hdf, pos, sqlite3_column_text(stmt, 2));
-		cp_set_author(hdf, pos, sqlite3_column_text(stmt, 3));
-		cp_set_link(hdf, pos, sqlite3_column_text(stmt, 4));
-		cp_set_date(hdf, pos, sqlite3_column_int64(stmt, 5));
-		cp_set_date_rfc822(hdf, pos, sqlite3_column_text(stmt, 6));
-		cp_set_date_iso8601(hdf, pos, sqlite3_column_text(stmt, 7));
-		cp_set_formated_date(hdf, pos, sqlite3_column_text(stmt, 8));
-		if (sqlite3_column_text(stmt, 10) != NULL && sqlite3_column_text(stmt, 10)[0] != '\0')
-			cp_set_description(hdf, pos, sqlite3_column_text(stmt, 10));
-		else if (sqlite3_column_text(stmt, 9) != NULL)
-			cp_set_description(hdf, pos, sqlite3_column_text(stmt, 9));
-
-		tpos = 0;
-		if (sqlite3_prepare_v2(db, "SELECT tag FROM tags WHERE uid=?1;",
-		    -1, &stmt2, 0) != SQLITE_OK) {
-			warnx("sqlite: %s", sqlite3_errmsg(db));
+	if (rebuild || optimize) {
+		if (argc != 0)
+			usage_search();
+		if (rebuild && fts_rebuild() != EXIT_SUCCESS)
 			return (EXIT_FAILURE);
-		}
+		if (optimize && sql_exec("INSERT INTO posts_fts(posts_fts) "
+		    "VALUES ('optimize');") != 0)
+			return (EXIT_FAILURE);
+		return (EXIT_SUCCESS);
+	}
 
-		sqlite3_bind_text(stmt2, 1, (char *)sqlite3_column_text(stmt, 11), -1, SQLITE_STATIC);
-		while (sqlite3_step(stmt2) == SQLITE_ROW) {
-			cp_set_tag(hdf, pos, tpos, sqlite3_column_text(stmt2, 0));
-			tpos++;
-		}
+	if (argc != 1)
+		usage_search();
 
-		sqlite3_finalize(stmt2);
-		pos++;
+	/* title and tags matches are worth more than the content ones */
+	if (sqlite3_prepare_v2(db, "SELECT posts.title, posts.name, posts.link, "
+	    "strftime('%Y-%m-%d', posts.date, 'unixepoch') AS date "
+	    "FROM posts_fts JOIN posts ON posts.rowid=posts_fts.rowid "
+	    "WHERE posts_fts MATCH ?1 "
+	    "ORDER BY bm25(posts_fts, 10.0, 2.0, 5.0, 1.0) LIMIT ?2;",
+	    -1, &stmt, NULL) != SQLITE_OK) {
+		warnx("sqlite: %s", sqlite3_errmsg(db));
+		return (EXIT_FAILURE);
 	}
 
-	sqlite3_finalize(stmt);
+	sqlite3_bind_text(stmt, 1, argv[0], -1, SQLITE_STATIC);
+	sqlite3_bind_int64(stmt, 2, limit);
 
-	sql_text(&val, "SELECT value FROM config WHERE key='title';");
-	hdf_set_valuef(hdf, "CPlanet.Name=%s", val);
-	free(val);
+	while ((ch = sqlite3_step(stmt)) == SQLITE_ROW)
+		print_row(stmt);
+	if (ch != SQLITE_DONE)
+		warnx("sqlite: %s", sqlite3_errmsg(db));
+
+	sqlite3_finalize(stmt);
 
-	sql_text(&val, "SELECT value FROM config WHERE key='description';");
-	hdf_set_valuef(hdf, "CPlanet.Description=%s", val);
-	free(val);
+	return (ch == SQLITE_DONE ? EXIT_SUCCESS : EXIT_FAILURE);
+}
 
-	sql_text(&val, "SELECT value FROM config WHERE key='url';");
-	hdf_set_valuef(hdf, "CPlanet.URL=%s", val);
-	free(val);
+/* the feed_stats rows stats reports on: of the feed ?1, NULL for all, since ?2 */
+#define STATS_WHERE "WHERE (?1 IS NULL OR name=?1) AND date >= ?2"
+
+static const struct stats_metric {
+	const char *column;
+	const char *label;
+} stats_metrics[] = {
+	{ "total", "total (ms)" },
+	{ "dns", "dns (ms)" },
+	{ "connect", "connect (ms)" },
+	{ "tls", "tls (ms)" },
+	{ "ttfb", "ttfb (ms)" },
+	{ "parse", "parse (ms)" },
+	{ "bytes", "bytes" },
+	{ "seen", "entries seen" },
+	{ "inserted", "entries inserted" },
+	{ "skipped", "entries skipped" },
+};
 
-	sql_text(&val, "SELECT strftime(value, 'now') from config where key='date_format';");
-	cp_set_gen_date(hdf, val);
-	free(val);
+/* nearest rank percentile of the n sorted values */
+static double
+percentile(const double *values, size_t n, int p)
+{
+	size_t rank;
 
-	sql_text(&val, "SELECT strftime('%Y-%m-%dT%H:%M:%SZ', 'now');");
-	cp_set_gen_iso8601(hdf, val);
-	free(val);
+	rank = (n * p + 99) / 100;
 
-	sql_text(&val, "SELECT strftime('%a, %d %b %Y %H:%M:%S %z', 'now');");
-	cp_set_gen_rfc822(hdf, val);
-	free(val);
+	return (values[rank > 0 ? rank - 1 : 0]);
+}
 
-	cp_set_version(hdf);
+static int
+stats_metric(const struct stats_metric *m, const char *feed, int64_t since)
+{
+	sqlite3_stmt *stmt;
+	double *values = NULL, *v;
+	size_t n = 0, cap = 0;
+	char *sql;
 
-	if (sqlite3_prepare_v2(db, "SELECT name, home, url from feed order by name;",
-	    -1, &stmt, 0) != SQLITE_OK) {
+	sql = sqlite3_mprintf("SELECT \"%w\" FROM feed_stats " STATS_WHERE
+	    " AND \"%w\" IS NOT NULL ORDER BY 1;", m->column, m->column);
+	if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
 		warnx("sqlite: %s", sqlite3_errmsg(db));
+		sqlite3_free(sql);
 		return (EXIT_FAILURE);
 	}
+	sqlite3_free(sql);
 
-	pos=0;
+	sqlite3_bind_text(stmt, 1, feed, -1, SQLITE_STATIC);
+	sqlite3_bind_int64(stmt, 2, since);
 	while (sqlite3_step(stmt) == SQLITE_ROW) {
-		hdf_set_valuef(hdf, "CPlanet.Feed.%i.Name=%s", pos, sqlite3_column_text(stmt, 0));
-		hdf_set_valuef(hdf, "CPlanet.Feed.%i.Home=%s", pos, sqlite3_column_text(stmt, 1));
-		hdf_set_valuef(hdf, "CPlanet.Feed.%i.URL=%s", pos, sqlite3_column_text(stmt, 2));
-		pos++;
+		if (n == cap) {
+			cap = cap == 0 ? 256 : cap * 2;
+			if ((v = realloc(values, cap * sizeof(double))) == NULL)
+				err(1, "realloc");
+			values = v;
+		}
+		values[n++] = sqlite3_column_double(stmt, 0);
 	}
+	sqlite3_finalize(stmt);
 
+	if (n > 0)
+		printf("%-20s%12.1f%12.1f%12.1f%12.1f\n", m->label,
+		    percentile(values, n, 50), percentile(values, n, 90),
+		    percentile(values, n, 99), values[n - 1]);
+	free(values);
+
+	return (EXIT_SUCCESS);
+}
+
+static int
+exec_stats(int argc, char **argv)
+{
+	sqlite3_stmt *stmt;
+	const char *errstr, *feed = NULL;
+	int64_t since = 0, runs;
+	unsigned int i;
+	int ch;
+
+	struct option longopts[] = {
+		{ "feed",	required_argument,	NULL,	'f' },
+		{ "since",	required_argument,	NULL,	's' },
+		{ NULL,		0,			NULL,	0 },
+	};
+
+	while ((ch = getopt_long(argc, argv, "f:s:", longopts, NULL)) != -1) {
+		switch (ch) {
+		case 'f':
+			feed = optarg;
+			break;
+		case 's':
+			since = strtonum(optarg, 0, INT64_MAX, &errstr);
+			if (errstr != NULL) {
+				warnx("Invalid timestamp '%s': %s", optarg, errstr);
+				return (EXIT_FAILURE);
+			}
+			break;
+		default:
+			usage_stats();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 0)
+		usage_stats();
+
+	if (sqlite3_prepare_v2(db, "SELECT count(*), count(DISTINCT name), "
+	    "count(error), min(date), max(date) FROM feed_stats " STATS_WHERE ";",
+	    -1, &stmt, NULL) != SQLITE_OK) {
+		warnx("sqlite: %s", sqlite3_errmsg(db));
+		return (EXIT_FAILURE);
+	}
+	sqlite3_bind_text(stmt, 1, feed, -1, SQLITE_STATIC);
+	sqlite3_bind_int64(stmt, 2, since);
+	sqlite3_step(stmt);
+	runs = sqlite3_column_int64(stmt, 0);
+	printf("runs: %lld, feeds: %lld, errors: %lld, from %lld to %lld\n\n",
+	    (long long)runs, (long long)sqlite3_column_int64(stmt, 1),
+	    (long long)sqlite3_column_int64(stmt, 2),
+	    (long long)sqlite3_column_int64(stmt, 3),
+	    (long long)sqlite3_column_int64(stmt, 4));
 	sqlite3_finalize(stmt);
+	if (runs == 0)
+		return (EXIT_SUCCESS);
 
-	if (sqlite3_prepare_v2(db, "SELECT path, template from output;",
-	    -1, &stmt, 0) != SQLITE_OK) {
+	printf("%-20s%12s%12s%12s%12s\n", "", "p50", "p90", "p99", "max");
+	for (i = 0; i < sizeof(stats_metrics) / sizeof(stats_metrics[0]); i++) {
+		if (stats_metric(&stats_metrics[i], feed, since) != EXIT_SUCCESS)
+			return (EXIT_FAILURE);
+	}
+
+	if (sqlite3_prepare_v2(db, "SELECT error, count(*) FROM feed_stats "
+	    STATS_WHERE " AND error IS NOT NULL GROUP BY error "
+	    "ORDER BY count(*) DESC, error;", -1, &stmt, NULL) != SQLITE_OK) {
 		warnx("sqlite: %s", sqlite3_errmsg(db));
 		return (EXIT_FAILURE);
 	}
+	sqlite3_bind_text(stmt, 1, feed, -1, SQLITE_STATIC);
+	sqlite3_bind_int64(stmt, 2, since);
+	for (i = 0; sqlite3_step(stmt) == SQLITE_ROW; i++)
+		printf("%s%s: %lld", i == 0 ? "\nerrors: " : ", ",
+		    sqlite3_column_text(stmt, 0),
+		    (long long)sqlite3_column_int64(stmt, 1));
+	if (i > 0)
+		printf("\n");
+	sqlite3_finalize(stmt);
 
+	/* where the update time goes: the feeds taking the longest overall */
+	if (sqlite3_prepare_v2(db, "SELECT name, count(*), avg(total), "
+	    "max(total), avg(parse), avg(bytes), count(error) FROM feed_stats "
+	    STATS_WHERE " GROUP BY name "
+	    "ORDER BY sum(coalesce(total, 0) + coalesce(parse, 0)) DESC LIMIT 10;",
+	    -1, &stmt, NULL) != SQLITE_OK) {
+		warnx("sqlite: %s", sqlite3_errmsg(db));
+		return (EXIT_FAILURE);
+	}
+	sqlite3_bind_text(stmt, 1, feed, -1, SQLITE_STATIC);
+	sqlite3_bind_int64(stmt, 2, since);
+	printf("\n%-20s%8s%12s%12s%12s%12s%8s\n", "slowest feeds", "runs",
+	    "avg (ms)", "max (ms)", "parse (ms)", "bytes", "errors");
 	while (sqlite3_step(stmt) == SQLITE_ROW)
-		generate_file(sqlite3_column_text(stmt, 0), sqlite3_column_text(stmt, 1), hdf);
-
+		printf("%-20s%8lld%12.1f%12.1f%12.1f%12.0f%8lld\n",
+		    sqlite3_column_text(stmt, 0),
+		    (long long)sqlite3_column_int64(stmt, 1),
+		    sqlite3_column_double(stmt, 2), sqlite3_column_double(stmt, 3),
+		    sqlite3_column_double(stmt, 4), sqlite3_column_double(stmt, 5),
+		    (long long)sqlite3_column_int64(stmt, 6));
 	sqlite3_finalize(stmt);
 
 	return (EXIT_SUCCESS);
 }
 
+static int
+exec_export(int argc, char **argv)
+{
+	const char *errstr;
+	int64_t since = 0, limit = 0, cursor;
+	int ch;
+
+	struct option longopts[] = {
+		{ "format",	required_argument,	NULL,	'f' },
+		{ "limit",	required_argument,	NULL,	'l' },
+		{ "since",	required_argument,	NULL,	's' },
+		{ NULL,		0,			NULL,	0 },
+	};
+
+	while ((ch = getopt_long(argc, argv, "f:l:s:", longopts, NULL)) != -1) {
+		switch (ch) {
+		case 'f':
+			if (strcmp(optarg, "ndjson") != 0) {
+				warnx("Unknown export format '%s'", optarg);
+				return (EXIT_FAILURE);
+			}
+			break;
+		case 'l':
+			limit = strtonum(optarg, 1, INT64_MAX, &errstr);
+			if (errstr != NULL) {
+				warnx("Invalid limit '%s': %s", optarg, errstr);
+				return (EXIT_FAILURE);
+			}
+			break;
+		case 's':
+			since = strtonum(optarg, 0, INT64_MAX, &errstr);
+			if (errstr != NULL) {
+				warnx("Invalid cursor '%s': %s", optarg, errstr);
+				return (EXIT_FAILURE);
+			}
+			break;
+		default:
+			usage_export();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 0)
+		usage_export();
+
+	if (cplanet_export(planet, stdout, since, limit, &cursor) != CPLANET_OK)
+		return (EXIT_FAILURE);
+
+	return (EXIT_SUCCESS);
+}
+
+static void
+sig_stop(int sig)
+{
+	stop = 1;
+}
+
+static int
+exec_update(int argc, char **argv)
+{
+	int ch, ret = EXIT_SUCCESS;
+	int64_t interval = 0, snapinterval = 0;
+	time_t start, lastsnap;
+	const char *errstr, *trace = NULL;
+	long jobs = 0;
+	bool force = false, snapshot = false;
+
+	struct option longopts[] = {
+		{ "trace",	required_argument,	NULL,	't' },
+		{ NULL,		0,			NULL,	0 },
+	};
+
+	while ((ch = getopt_long(argc, argv, "fi:j:s:t:", longopts, NULL)) != -1) {
+		switch (ch) {
+		case 'f':
+			force = true;
+			break;
+		case 't':
+			trace = optarg;
+			break;
+		case 'j':
+			jobs = strtonum(optarg, 1, 256, &errstr);
+			if (errstr != NULL)
+				errx(EXIT_FAILURE, "Invalid number of jobs '%s': %s", optarg, errstr);
+			break;
+		case 'i':
+			interval = strtonum(optarg, 1, INT_MAX, &errstr);
+			if (errstr != NULL)
+				errx(EXIT_FAILURE, "Invalid interval '%s': %s", optarg, errstr);
+			break;
+		case 's':
+			snapinterval = strtonum(optarg, 0, INT_MAX, &errstr);
+			if (errstr != NULL)
+				errx(EXIT_FAILURE, "Invalid interval '%s': %s", optarg, errstr);
+			snapshot = true;
+			break;
+		default:
+			usage_update();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 0)
+		usage_update();
+
+	/* without -m the database is written as the update goes */
+	if (snapshot && !planet->inmemory)
+		errx(EXIT_FAILURE, "-s is only meaningful with -m");
+
+	if ((jobs != 0 && cplanet_jobs(planet, jobs) != CPLANET_OK) ||
+	    (trace != NULL && cplanet_trace(planet, trace) != CPLANET_OK))
+		return (EXIT_FAILURE);
+
+	if (interval == 0) {
+		ret = cplanet_update(planet, force ? CPLANET_FORCE : 0);
+		if (cplanet_trace(planet, NULL) != CPLANET_OK)
+			ret = CPLANET_ERROR;
+		return (ret == CPLANET_OK ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	signal(SIGINT, sig_stop);
+	signal(SIGTERM, sig_stop);
+	signal(SIGHUP, sig_stop);
+
+	lastsnap = time(NULL);
+	while (!stop) {
+		start = time(NULL);
+		/*
+		 * pick up the configuration changes between two cycles; with
+		 * -m they are made to the file, which the next snapshot then
+		 * refuses to overwrite
+		 */
+		cplanet_reload(planet);
+		if (cplanet_update(planet, force ? CPLANET_FORCE : 0) != CPLANET_OK)
+			warnx("update failed");
+		force = false;
+
+		/*
+		 * bound the work lost if we die to the snapshot interval, an
+		 * update which cannot be kept is not worth going on with
+		 */
+		if (time(NULL) - lastsnap >= snapinterval) {
+			if (cplanet_snapshot(planet) != CPLANET_OK) {
+				warnx("snapshot failed, stopping");
+				ret = EXIT_FAILURE;
+				break;
+			}
+			lastsnap = time(NULL);
+		}
+
+		while (!stop && time(NULL) - start < interval)
+			sleep(interval - (time(NULL) - start));
+	}
+	cplanet_trace(planet, NULL);
+
+	return (ret);
+}
+
 static struct commands {
 	const char * const name;
 	const char * const desc;
@@ -892,59 +890,15 @@ static struct commands {
 	{ "feed", "Manipulate feeds", exec_feed, usage_feed },
 	{ "config", "Modify configuration", exec_config, usage_config },
 	{ "output", "Configure output files", exec_output, usage_output },
+	{ "archive", "Configure the archives", exec_archive, usage_archive },
+	{ "search", "Search the posts", exec_search, usage_search },
+	{ "stats", "Report feed statistics", exec_stats, usage_stats },
+	{ "export", "Export the posts changed since a cursor", exec_export, usage_export },
 	{ "update", "Update the planet", exec_update, usage_update },
 };
 
 static const unsigned int cmd_len = sizeof(cmd) / sizeof(cmd[0]);
 
-static bool
-db_open(const char *dbpath)
-{
-	int ret;
-
-	if (sqlite3_open(dbpath, &db) != SQLITE_OK) {
-		warnx("%s", sqlite3_errmsg(db));
-		return (false);
-	}
-
-	ret = sql_exec(
-	    "CREATE TABLE IF NOT EXISTS config "
-	      "(key TEXT NOT NULL UNIQUE, "
-	      "value);"
-	    "CREATE TABLE IF NOT EXISTS feed "
-	      "(name TEXT NOT NULL UNIQUE, "
-	      "url TEXT NOT NULL UNIQUE, "
-	      "home TEXT NOT NULL UNIQUE); "
-	    "CREATE TABLE IF NOT EXISTS output "
-	      "(path UNIQUE, template);"
-	    "CREATE TABLE IF NOT EXISTS posts "
-	      "(uid UNIQUE, name, blog_title, title, "
-	      "author, link, content, "
-	      "description, date, updated, tags);"
-	    "CREATE TABLE IF NOT EXISTS tags "
-	      "(uid, tag, UNIQUE(uid, tag));"
-
-/* Popupate with default data */
-	    "INSERT OR IGNORE INTO config values "
-	      "('title', 'default');"
-	    "INSERT OR IGNORE INTO config values "
-	      "('description', 'default');"
-	    "INSERT OR IGNORE INTO config values "
-	      "('date_format', '%%d/%%m/%%Y');"
-	    "INSERT OR IGNORE INTO config values "
-	      "('max_post', 10);"
-	    "INSERT OR IGNORE INTO config values "
-	      "('url', 'http://undefined');"
-	      );
-
-	if (ret < 0) {
-		warnx("%s", sqlite3_errmsg(db));
-		return (false);
-	}
-
-	return (true);
-}
-
 int
 main (int argc, char *argv[])
 {
@@ -956,13 +910,15 @@ main (int argc, char *argv[])
 	struct commands *command = NULL;
 	char tmpdbpath[MAXPATHLEN];
 	const char *dbpath = NULL;
+	int flags = 0, initflags = 0;
 
 	t_now = time(NULL);
 
 	if (argc == 1)
 		usage();
 
-	while ((ch = getopt(argc, argv, "c:hd:")) != -1)
+	/* stop at the command, its options are its own */
+	while ((ch = getopt_long(argc, argv, "+c:hd:mMv", NULL, NULL)) != -1)
 		switch (ch) {
 			case 'h':
 				usage();
@@ -970,6 +926,15 @@ main (int argc, char *argv[])
 			case 'd':
 				dbpath = optarg;
 				break;
+			case 'm':
+				flags |= CPLANET_INMEMORY;
+				break;
+			case 'M':
+				initflags |= CPLANET_MEMSTATS;
+				break;
+			case 'v':
+				flags |= CPLANET_VERBOSE;
+				break;
 			case 'c':
 				hdf_file = optarg;
 				if(access(hdf_file, F_OK | R_OK) == -1 )
@@ -1021,17 +986,36 @@ main (int argc, char *argv[])
 		dbpath = tmpdbpath;
 	}
 
-	sqlite3_initialize();
+	/* export is polled while updates run, it must not wait to write */
+	if (command->exec == exec_export)
+		flags |= CPLANET_READONLY;
 
-	if (!db_open(dbpath))
+	if (cplanet_init(initflags) != CPLANET_OK)
+		return (EXIT_FAILURE);
+	if (cplanet_open(dbpath, flags, &planet) != CPLANET_OK) {
+		cplanet_close(planet);
+		cplanet_shutdown();
 		return (EXIT_FAILURE);
+	}
+	db = cplanet_db(planet);
 
-	argc -= optind;
-	argv += optind;
+	/* commands parse their own arguments, argv[0] being the command */
+#ifdef __GLIBC__
+	optind = 0;
+#else
+	optreset = 1;
+	optind = 1;
+#endif
 
 	assert(command->exec != NULL);
 	ret = command->exec(argc, argv);
-	sqlite3_shutdown();
+
+	if (sqlite3_total_changes(db) > 0 &&
+	    cplanet_snapshot(planet) != CPLANET_OK)
+		ret = EXIT_FAILURE;
+
+	cplanet_close(planet);
+	cplanet_shutdown();
 
 	return (ret);
 }
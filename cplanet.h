@@ -55,6 +55,13 @@
 #define CP_FORMATED_DATE  "CPlanet.Posts.%i.FormatedDate=%s"
 #define CP_DESCRIPTION "CPlanet.Posts.%i.Description=%s"
 #define CP_TAG "CPlanet.Posts.%i.Tags.%i.Tag=%s"
+#define CP_TOP_TAG "CPlanet.Tags.%i.Tag=%s"
+#define CP_TOP_TAG_COUNT "CPlanet.Tags.%i.Count=%lld"
+#define CP_TOP_TAG_LAST_SEEN "CPlanet.Tags.%i.LastSeen=%lld"
+#define CP_ARCHIVE_KIND "CPlanet.Archive.Kind=%s"
+#define CP_ARCHIVE_KEY "CPlanet.Archive.Key=%s"
+#define CP_ARCHIVE_PAGE "CPlanet.Archive.Page=%lld"
+#define CP_ARCHIVE_LINK "CPlanet.Archive.%s=%s"
 #define CP_VERSION "CPlanet.Version=%s"
 #define CP_GEN_DATE "CPlanet.GenerationDate=%s"
 #define CP_GEN_DATE_ISO8601 "CPlanet.GenerationDateISO8601=%s"
@@ -73,6 +80,12 @@
 #define cp_set_formated_date(hdf_dest, ...) hdf_set_valuef(hdf_dest, CP_FORMATED_DATE, ##__VA_ARGS__)
 #define cp_set_description(hdf_dest, ...) hdf_set_valuef(hdf_dest, CP_DESCRIPTION, ##__VA_ARGS__)
 #define cp_set_tag(hdf_dest, ...) hdf_set_valuef(hdf_dest, CP_TAG, ##__VA_ARGS__)
+#define cp_set_top_tag(hdf_dest, ...) hdf_set_valuef(hdf_dest, CP_TOP_TAG, ##__VA_ARGS__)
+#define cp_set_top_tag_count(hdf_dest, ...) hdf_set_valuef(hdf_dest, CP_TOP_TAG_COUNT, ##__VA_ARGS__)
+#define cp_set_top_tag_last_seen(hdf_dest, ...) hdf_set_valuef(hdf_dest, CP_TOP_TAG_LAST_SEEN, ##__VA_ARGS__)
+#define cp_set_archive_kind(hdf_dest, ...) hdf_set_valuef(hdf_dest, CP_ARCHIVE_KIND, ##__VA_ARGS__)
+#define cp_set_archive_key(hdf_dest, ...) hdf_set_valuef(hdf_dest, CP_ARCHIVE_KEY, ##__VA_ARGS__)
+#define cp_set_archive_page(hdf_dest, ...) hdf_set_valuef(hdf_dest, CP_ARCHIVE_PAGE, ##__VA_ARGS__)
 #define cp_set_version(hdf_dest) hdf_set_valuef(hdf_dest, CP_VERSION, CPLANET_VERSION)
 #define cp_set_gen_date(hdf_dest, ...) hdf_set_valuef(hdf_dest, CP_GEN_DATE, ##__VA_ARGS__)
 #define cp_set_gen_rfc822(hdf_dest, ...) hdf_set_valuef(hdf_dest, CP_GEN_DATE_RFC822, ##__VA_ARGS__)
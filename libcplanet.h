@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2010, Baptiste Daroussin
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Embedding cplanet: a planet is opened on its database and owns the sqlite
+ * handle, the prepared statements, the configuration, the dataset and the
+ * parsed templates. Feeds and outputs are managed with sql on the handle
+ * returned by cplanet_db(), as the cplanet command does.
+ *
+ * Thread safety: cplanet_init() is called once before anything else and
+ * cplanet_shutdown() once all the planets are closed, no other thread using
+ * the library meanwhile. A planet can be used from any thread but from one
+ * at a time; distinct planets can be used at once from distinct threads.
+ * The render threads of an update are its own and are joined before it
+ * returns. The memory accounting of CPLANET_MEMSTATS is process wide.
+ *
+ * The functions return CPLANET_OK or CPLANET_ERROR, cplanet_errmsg() then
+ * tells the last error of the planet. Nothing exits the process, but for a
+ * failed allocation in the string buffers.
+ */
+
+#ifndef LIBCPLANET_H
+#define LIBCPLANET_H 1
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <sqlite3.h>
+
+#define CPLANET_OK	0
+#define CPLANET_ERROR	1
+
+/* cplanet_init() */
+#define CPLANET_MEMSTATS	0x1	/* account the memory, report on shutdown */
+
+/* cplanet_open() */
+#define CPLANET_INMEMORY	0x1	/* work on an in-memory copy of dbpath */
+#define CPLANET_VERBOSE		0x2	/* report what is done on stderr */
+#define CPLANET_QUIET		0x4	/* warnings are only kept for errmsg */
+#define CPLANET_READONLY	0x8	/* only read, alongside a running update */
+
+/* cplanet_update() */
+#define CPLANET_FORCE		0x1	/* write the outputs even unchanged */
+#define CPLANET_NOFETCH		0x2	/* render what is in the database */
+
+struct cplanet;
+
+int cplanet_init(int flags);
+void cplanet_shutdown(void);
+
+/*
+ * *planetp is set even on failure, for cplanet_errmsg(), and is to be
+ * closed; it is only NULL when it could not be allocated
+ */
+int cplanet_open(const char *dbpath, int flags, struct cplanet **planetp);
+void cplanet_close(struct cplanet *planet);
+
+const char *cplanet_errmsg(struct cplanet *planet);
+sqlite3 *cplanet_db(struct cplanet *planet);
+
+/*
+ * read the config table again, it is read once when opening; an in-memory
+ * planet reads its own copy, not the changes made to the file since
+ */
+int cplanet_reload(struct cplanet *planet);
+/* write an in-memory planet back to its database file */
+int cplanet_snapshot(struct cplanet *planet);
+
+/* render on up to jobs threads, 0 for one per CPU which is the default */
+int cplanet_jobs(struct cplanet *planet, long jobs);
+/* write a Chrome trace of the updates to path, NULL to stop */
+int cplanet_trace(struct cplanet *planet, const char *path);
+
+/* fetch the feeds, then render the outputs and the archives */
+int cplanet_update(struct cplanet *planet, int flags);
+
+/*
+ * write the posts stored or changed after the cursor since to out as NDJSON,
+ * one object with its tags per line in the order of the changes, at most
+ * limit of them unless 0; *cursor is set to resume from, 0 is the start
+ */
+int cplanet_export(struct cplanet *planet, FILE *out, int64_t since,
+    int64_t limit, int64_t *cursor);
+
+#endif
@@ -0,0 +1,35 @@
+<!DOCTYPE html PUBLIC "-//W3C//DTD XHTML 1.0 Transitional//EN" "http://www.w3.org/TR/xhtml1/DTD/xhtml1-transitional.dtd">
+<html xmlns="http://www.w3.org/1999/xhtml">
+    <head>
+	<meta http-equiv="Content-Type" content="text/html; charset=UTF-8" />
+	<meta name="generator" content="CPlanet <?cs var:CPlanet.Version ?>" />
+	<link rel="stylesheet" type="text/css" href="/style.css" />
+	<title><?cs var:CPlanet.Name ?><?cs if:CPlanet.Archive.Key ?> - <?cs var:CPlanet.Archive.Key ?><?cs /if ?> - <?cs var:CPlanet.Archive.Page ?></title>
+    </head>
+    <body>
+	<div id="contener">
+	    <div id="header">
+		<h1><a href="/"><?cs var:CPlanet.Name ?></a></h1>
+		<h2><?cs if:CPlanet.Archive.Key ?><?cs var:CPlanet.Archive.Key ?> - <?cs /if ?>Page <?cs var:CPlanet.Archive.Page ?></h2>
+	    </div>
+	    <div id="content">
+		<?cs each:post = CPlanet.Posts ?>
+		<br />
+		<div class="date"><?cs alt:post.FormatedDate ?><cs ? var:post.Date ?><?cs /alt ?></div>
+		<h2 class="storytitle"><a href="<?cs var:post.Link ?>"><?cs var:post.FeedName ?> >> <?cs var:post.Title ?></a></h2>
+		<div class="comments"><?cs if:post.Author ?>Par : <?cs var:post.Author  ?> <?cs /if ?></div>
+		<div class="comments">Tags: <?cs each:tags = post.Tags ?><div class="tags"><?cs var:tags.Tag ?></div> <?cs /each ?></div>
+		<?cs var:post.Description ?>
+		<?cs /each ?>
+		<div class="pages">
+		    <?cs if:CPlanet.Archive.Next ?><a href="<?cs var:CPlanet.Archive.Next ?>">&lt;&lt; Newer</a><?cs /if ?>
+		    <?cs if:CPlanet.Archive.Prev ?><a href="<?cs var:CPlanet.Archive.Prev ?>">Older &gt;&gt;</a><?cs /if ?>
+		</div>
+	    </div>
+	    <div id="footer">
+		<a href="http://wiki.github.com/bapt/CPlanet">Powered by CPlanet <?cs var:CPlanet.Version ?></a>
+	    </div>
+
+	</div>
+    </body>
+</html>
@@ -33,6 +33,12 @@
 			<li class="syndicate"><a class="feed" href="/index.rss">RSS 2.0</a></li>
 			<li class="syndicate"><a class="feed" href="/index.atom">ATOM 1.0</a></li>
 		</ul>
+		<div class="menutitle">Tags</div>
+		<ul>
+		    <?cs each:tag = CPlanet.Tags ?>
+		    <li><?cs var:tag.Tag ?> (<?cs var:tag.Count ?>)</li>
+		    <?cs /each ?>
+		</ul>
 	    </div>
 	    <div id="content">
 		<?cs each:post = CPlanet.Posts ?>
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2010, Baptiste Daroussin
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * helpers of the checks of make check; each check includes core.c before
+ * this header to reach its static functions
+ */
+
+#ifndef CHECK_H
+#define CHECK_H 1
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct cplanet *check_planet;
+static int check_failures;
+
+#define CHECK(cond) do {						\
+	if (!(cond)) {							\
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);	\
+		check_failures++;					\
+	}								\
+} while (0)
+
+#define CHECK_STR(got, want)	check_str(__FILE__, __LINE__, (got), (want))
+#define CHECK_INT(got, want)	check_int(__FILE__, __LINE__, (got), (want))
+
+static void
+check_str(const char *file, int line, const char *got, const char *want)
+{
+	if (got != NULL && strcmp(got, want) == 0)
+		return;
+	fprintf(stderr, "%s:%d: got \"%s\", want \"%s\"\n", file, line,
+	    got != NULL ? got : "(null)", want);
+	check_failures++;
+}
+
+static void
+check_int(const char *file, int line, int64_t got, int64_t want)
+{
+	if (got == want)
+		return;
+	fprintf(stderr, "%s:%d: got %lld, want %lld\n", file, line,
+	    (long long)got, (long long)want);
+	check_failures++;
+}
+
+/* a scratch in-memory database, never written back */
+static void
+check_db(void)
+{
+	if (cplanet_init(0) != CPLANET_OK ||
+	    cplanet_open("check.db", CPLANET_INMEMORY, &check_planet) != CPLANET_OK)
+		errx(1, "Unable to set up the database: %s",
+		    cplanet_errmsg(check_planet));
+}
+
+static void
+check_config(const char *key, const char *value)
+{
+	if (sql_exec("REPLACE INTO config VALUES (%Q, %Q);", key, value) != 0 ||
+	    cplanet_reload(check_planet) != CPLANET_OK)
+		errx(1, "Unable to set %s", key);
+}
+
+/* the integer the query returns, -1 if it fails */
+static int64_t
+check_count(const char *sql)
+{
+	int64_t n = -1;
+
+	if (sql_int(&n, "%s", sql) != 0)
+		return (-1);
+
+	return (n);
+}
+
+/* store the feed name from body, 0 if it parsed */
+static int
+check_parse(const char *name, const char *body)
+{
+	struct feed_stats st;
+
+	memset(&st, 0, sizeof(st));
+
+	return (parse_posts((const unsigned char *)name, body, strlen(body),
+	    name, &st));
+}
+
+/* the exit status of the check */
+static int
+check_done(void)
+{
+	if (check_planet != NULL) {
+		cplanet_close(check_planet);
+		cplanet_shutdown();
+	}
+	if (check_failures > 0)
+		fprintf(stderr, "%d failed\n", check_failures);
+
+	return (check_failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+#endif
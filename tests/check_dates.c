@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2010, Baptiste Daroussin
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* the dates formatted from the per-thread cache are those of strftime(3) */
+
+#include "../core.c"
+#include "check.h"
+
+#define NDATES 2000
+#define NTHREADS 4
+
+static const char *formats[] = {
+	"%d/%m/%Y",		/* the default date_format */
+	"%Y-%m-%d %H:%M",
+	"%A %e %B %Y",
+	"%%H is not the hour",
+	"%T",
+	"",
+};
+#define NFORMATS (sizeof(formats) / sizeof(formats[0]))
+
+/* spread over 1960 to 2040, with a few posts on the same day */
+static int64_t
+date_of(int i)
+{
+	return (-315619200 + (int64_t)i * 1262293 + (i % 3) * 3599);
+}
+
+static int
+check_date(int64_t date, const char *format)
+{
+	const struct dates *d;
+	struct tm tm;
+	time_t t = (time_t)date;
+	char want[128];
+	int failures = 0;
+
+	gmtime_r(&t, &tm);
+	d = post_dates(date, format);
+
+	strftime(want, sizeof(want), "%a, %d %b %Y %H:%M:%S +0000", &tm);
+	failures += strcmp(d->rfc822, want) != 0;
+	strftime(want, sizeof(want), "%Y-%m-%dT%H:%M:%SZ", &tm);
+	failures += strcmp(d->iso8601, want) != 0;
+	if (strftime(want, sizeof(want), format, &tm) == 0)
+		want[0] = '\0';
+	failures += strcmp(d->formated, want) != 0;
+	if (failures > 0)
+		fprintf(stderr, "%lld with \"%s\": \"%s\", \"%s\", \"%s\"\n",
+		    (long long)date, format, d->rfc822, d->iso8601, d->formated);
+
+	return (failures);
+}
+
+/* every thread goes through the formats in its own order */
+static void *
+check_thread(void *arg)
+{
+	intptr_t n = (intptr_t)arg;
+	int i, failures = 0;
+
+	for (i = 0; i < NDATES; i++)
+		failures += check_date(date_of(i),
+		    formats[(i / 7 + n) % NFORMATS]);
+
+	return ((void *)(intptr_t)failures);
+}
+
+int
+main(void)
+{
+	pthread_t threads[NTHREADS];
+	void *failures;
+	size_t f;
+	int i;
+
+	/* the date_format changes between two updates */
+	for (f = 0; f < NFORMATS; f++) {
+		for (i = 0; i < NDATES; i++)
+			CHECK(check_date(date_of(i), formats[f]) == 0);
+	}
+
+	/* the same date in another format, then back */
+	CHECK(check_date(1700000000, formats[0]) == 0);
+	CHECK(check_date(1700000000, formats[1]) == 0);
+	CHECK(check_date(1700000000, formats[0]) == 0);
+	CHECK(check_date(1700000000 + 60, formats[1]) == 0);
+	CHECK(check_date(-1, formats[1]) == 0);
+
+	/* the render threads each have their cache */
+	for (i = 0; i < NTHREADS; i++) {
+		if (pthread_create(&threads[i], NULL, check_thread,
+		    (void *)(intptr_t)i) != 0)
+			err(1, "pthread_create");
+	}
+	for (i = 0; i < NTHREADS; i++) {
+		pthread_join(threads[i], &failures);
+		CHECK(failures == NULL);
+	}
+
+	return (check_done());
+}
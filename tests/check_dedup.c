@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2010, Baptiste Daroussin
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* the posts syndicated by several feeds are stored once */
+
+#include "../core.c"
+#include "check.h"
+
+#define ITEM(uid, link, tag, text) \
+	"<item><guid>" uid "</guid><title>" uid "</title>" \
+	"<link>" link "</link><category>" tag "</category>" \
+	"<pubDate>Tue, 14 Nov 2023 22:13:20 +0000</pubDate>" \
+	"<description>" text "</description></item>"
+#define RSS(items) \
+	"<?xml version=\"1.0\"?><rss version=\"2.0\"><channel>" \
+	"<title>feed</title>" items "</channel></rss>"
+
+/* long enough to be told apart by its content alone */
+#define LONG_TEXT \
+	"The same article, syndicated word for word by two planets which " \
+	"both carry it in full, is long enough not to be the same as another " \
+	"one by chance: more than two hundred characters of text once the " \
+	"markup is gone."
+
+static void
+check_canonical(const char *link, const char *want)
+{
+	UT_string *out;
+
+	utstring_new(out);
+	link_canonical(link, out);
+	CHECK_STR(utstring_body(out), want);
+	utstring_free(out);
+}
+
+int
+main(void)
+{
+	check_canonical("https://www.Example.COM:443/post/?utm_source=rss&id=3"
+	    "&utm_medium=feed#comments", "example.com/post?id=3");
+	check_canonical("http://example.com:80/post/", "example.com/post");
+	check_canonical("http://example.com/post?utm_source=a&utm_campaign=b",
+	    "example.com/post");
+	check_canonical("http://example.com:8080/post", "example.com:8080/post");
+
+	check_db();
+
+	/* without dedup every feed keeps its copy */
+	CHECK_INT(check_parse("a", RSS(ITEM("urn:a:0",
+	    "http://example.com/zero", "x", "zero"))), 0);
+	CHECK_INT(check_parse("b", RSS(ITEM("urn:b:0",
+	    "https://www.example.com/zero/", "y", "zero"))), 0);
+	CHECK_INT(check_count("SELECT count(*) FROM posts "
+	    "WHERE uid IN ('urn:a:0', 'urn:b:0');"), 2);
+	CHECK_INT(check_count("SELECT count(*) FROM duplicates;"), 0);
+
+	check_config("dedup", "1");
+
+	/* the same link once canonical */
+	CHECK_INT(check_parse("a", RSS(ITEM("urn:a:1",
+	    "http://example.com/post?id=1&amp;utm_source=a", "alpha", "one"))), 0);
+	CHECK_INT(check_parse("b", RSS(ITEM("urn:b:1",
+	    "https://www.Example.com/post/?utm_medium=b&amp;id=1#top", "beta",
+	    "another text"))), 0);
+	CHECK_INT(check_count("SELECT count(*) FROM posts "
+	    "WHERE uid='urn:b:1';"), 0);
+	CHECK_INT(check_count("SELECT count(*) FROM duplicates WHERE "
+	    "uid='urn:b:1' AND name='b' AND post='urn:a:1';"), 1);
+	/* the primary post gets the tags of its copies */
+	CHECK_INT(check_count("SELECT count(*) FROM tags "
+	    "WHERE uid='urn:a:1' AND tag IN ('alpha', 'beta');"), 2);
+
+	/* the same content behind other links */
+	CHECK_INT(check_parse("a", RSS(ITEM("urn:a:2", "http://a.example.com/2",
+	    "x", "&lt;p&gt;" LONG_TEXT "&lt;/p&gt;"))), 0);
+	CHECK_INT(check_parse("b", RSS(ITEM("urn:b:2",
+	    "http://b.example.com/2", "x", LONG_TEXT))), 0);
+	CHECK_INT(check_count("SELECT count(*) FROM duplicates WHERE "
+	    "uid='urn:b:2' AND post='urn:a:2';"), 1);
+
+	/* a short content is not enough */
+	CHECK_INT(check_parse("a", RSS(ITEM("urn:a:3",
+	    "http://a.example.com/3", "x", "short"))), 0);
+	CHECK_INT(check_parse("b", RSS(ITEM("urn:b:3",
+	    "http://b.example.com/3", "x", "short"))), 0);
+	CHECK_INT(check_count("SELECT count(*) FROM posts "
+	    "WHERE uid IN ('urn:a:3', 'urn:b:3');"), 2);
+
+	/* a copy stored before dedup was set is removed when it changes */
+	check_config("dedup", "0");
+	CHECK_INT(check_parse("b", RSS(ITEM("urn:b:4",
+	    "http://example.com/4", "x", "four"))), 0);
+	check_config("dedup", "1");
+	CHECK_INT(check_parse("a", RSS(ITEM("urn:a:4",
+	    "http://example.com/4", "x", "four"))), 0);
+	CHECK_INT(check_parse("b", RSS(ITEM("urn:b:4",
+	    "http://example.com/4", "x", "four, edited"))), 0);
+	CHECK_INT(check_count("SELECT count(*) FROM posts "
+	    "WHERE uid='urn:b:4';"), 0);
+	CHECK_INT(check_count("SELECT count(*) FROM duplicates WHERE "
+	    "uid='urn:b:4' AND post='urn:a:4';"), 1);
+
+	return (check_done());
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2010, Baptiste Daroussin
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* resuming the export from its cursor gives each change once */
+
+#include "../core.c"
+#include "check.h"
+
+#define ITEM(uid, link, tag, text) \
+	"<item><guid>" uid "</guid><title>" uid "</title>" \
+	"<link>" link "</link><category>" tag "</category>" \
+	"<pubDate>Tue, 14 Nov 2023 22:13:20 +0000</pubDate>" \
+	"<description>" text "</description></item>"
+#define RSS(items) \
+	"<?xml version=\"1.0\"?><rss version=\"2.0\"><channel>" \
+	"<title>feed</title>" items "</channel></rss>"
+
+#define FEED_A(two, more) RSS( \
+	ITEM("a:0", "http://example.com/0", "x", "zero") \
+	ITEM("a:1", "http://example.com/1", "x", "one") \
+	ITEM("a:2", "http://example.com/2", "x", two) \
+	ITEM("a:3", "http://example.com/3", "x", "three") \
+	ITEM("a:4", "http://example.com/4", "x", "four") more)
+
+static int64_t cursor;
+
+/*
+ * export from the cursor in pages of limit posts, the ids separated by
+ * spaces as they come; every cursor is past the one before
+ */
+static char *
+export(int64_t limit)
+{
+	UT_string *ids;
+	FILE *f;
+	char *buf, *line, *id, *end;
+	size_t len;
+	int64_t prev, n;
+	char *ret;
+
+	utstring_new(ids);
+	do {
+		if ((f = open_memstream(&buf, &len)) == NULL)
+			err(1, "open_memstream");
+		prev = cursor;
+		CHECK_INT(cplanet_export(check_planet, f, cursor, limit,
+		    &cursor), CPLANET_OK);
+		fclose(f);
+
+		n = 0;
+		for (line = buf; *line != '\0'; line = end + 1) {
+			end = strchr(line, '\n');
+			CHECK(end != NULL);
+			if (end == NULL)
+				break;
+			CHECK(strncmp(line, "{\"cursor\":", 10) == 0);
+			CHECK(strtoll(line + 10, &id, 10) > prev);
+			prev = strtoll(line + 10, &id, 10);
+			CHECK(strncmp(id, ",\"id\":\"", 7) == 0);
+			id += 7;
+			utstring_printf(ids, "%s%.*s", utstring_len(ids) > 0 ?
+			    " " : "", (int)strcspn(id, "\""), id);
+			n++;
+		}
+		CHECK(limit == 0 || n <= limit);
+		/* the cursor is that of the last post written */
+		CHECK_INT(cursor, prev);
+		free(buf);
+	} while (limit > 0 && n == limit);
+
+	ret = strdup(utstring_body(ids));
+	utstring_free(ids);
+
+	return (ret);
+}
+
+static void
+check_export(int64_t limit, const char *want)
+{
+	char *got;
+
+	got = export(limit);
+	CHECK_STR(got, want);
+	free(got);
+}
+
+int
+main(void)
+{
+	int64_t limit;
+
+	check_db();
+
+	/* all of it, then nothing more, whatever the page size */
+	for (limit = 0; limit <= 6; limit++) {
+		cursor = 0;
+		if (limit == 0)
+			CHECK_INT(check_parse("a", FEED_A("two", "")), 0);
+		check_export(limit, "a:0 a:1 a:2 a:3 a:4");
+		check_export(limit, "");
+	}
+
+	/* a changed post and a new one, an unchanged feed nothing */
+	CHECK_INT(check_parse("a", FEED_A("two, edited",
+	    ITEM("a:5", "http://example.com/5", "x", "five"))), 0);
+	check_export(2, "a:2 a:5");
+	CHECK_INT(check_parse("a", FEED_A("two, edited",
+	    ITEM("a:5", "http://example.com/5", "x", "five"))), 0);
+	check_export(2, "");
+
+	/*
+	 * the last change is a copy later removed as a duplicate, the tags
+	 * it brings to its primary and the posts after are still changes
+	 */
+	check_config("dedup", "1");
+	CHECK_INT(check_parse("a", FEED_A("two, edited",
+	    ITEM("a:5", "http://example.com/5", "x", "five")
+	    ITEM("a:6", "http://example.com/6", "x", "six"))), 0);
+	check_config("dedup", "0");
+	CHECK_INT(check_parse("b", RSS(ITEM("b:0", "http://example.com/6",
+	    "y", "six"))), 0);
+	check_export(0, "a:6 b:0");
+	check_config("dedup", "1");
+	CHECK_INT(check_parse("b", RSS(ITEM("b:0", "http://example.com/6",
+	    "y", "six, edited"))), 0);
+	CHECK_INT(check_count("SELECT count(*) FROM posts WHERE uid='b:0';"), 0);
+	check_export(0, "a:6");
+	CHECK_INT(check_parse("b", RSS(ITEM("b:0", "http://example.com/6",
+	    "y", "six, edited") ITEM("b:1", "http://example.com/b1", "y",
+	    "one"))), 0);
+	check_export(1, "b:1");
+
+	return (check_done());
+}
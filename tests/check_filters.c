@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2010, Baptiste Daroussin
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * the posts dataset_build gives each output, the filtered ones merged with
+ * the scan of the others, are those its filter selects on its own
+ */
+
+#include "../core.c"
+#include "check.h"
+
+#define NENTRIES 24
+#define NVIEWS 6
+
+/* x and y post at the same dates, the ties are ordered by uid */
+static void
+store_feed(const char *name)
+{
+	UT_string *body;
+	int i;
+
+	utstring_new(body);
+	utstring_printf(body, "<?xml version=\"1.0\"?><rss version=\"2.0\">"
+	    "<channel><title>%s</title>", name);
+	for (i = 0; i < NENTRIES; i++) {
+		utstring_printf(body, "<item><guid>%s:%02d</guid>"
+		    "<title>%s:%02d</title><link>http://%s.invalid/%d</link>"
+		    "<pubDate>Tue, %02d Nov 2023 10:00:00 +0000</pubDate>",
+		    name, i, name, i, name, i, 1 + i / 2);
+		if (i % 2 == 0)
+			utstring_printf(body, "<category>even</category>");
+		if (i % 3 == 0)
+			utstring_printf(body, "<category>third</category>");
+		utstring_printf(body, "<description>%d</description></item>", i);
+	}
+	utstring_printf(body, "</channel></rss>");
+	CHECK_INT(check_parse(name, utstring_body(body)), 0);
+	utstring_free(body);
+}
+
+/* the titles of the posts v selects, as its filter alone would */
+static void
+check_view(struct view *v)
+{
+	sqlite3_stmt *stmt;
+	const char *got;
+	char key[128];
+	int64_t n = 0;
+
+	if (sqlite3_prepare_v2(cp->db, "SELECT title FROM posts "
+	    "WHERE (?1 IS NULL OR name=?1) AND (?2 IS NULL OR uid IN "
+	    "(SELECT uid FROM tags WHERE tag=?2)) "
+	    "ORDER BY date DESC, uid DESC LIMIT ?3;", -1, &stmt,
+	    NULL) != SQLITE_OK)
+		errx(1, "sqlite: %s", sqlite3_errmsg(cp->db));
+	sqlite3_bind_text(stmt, 1, v->filter.feed, -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 2, v->filter.tag, -1, SQLITE_STATIC);
+	sqlite3_bind_int64(stmt, 3, v->filter.limit);
+	while (sqlite3_step(stmt) == SQLITE_ROW) {
+		snprintf(key, sizeof(key), "Output.%lld.CPlanet.Posts.%lld.Title",
+		    (long long)v->rowid, (long long)n++);
+		got = hdf_get_value(cp->dataset, key, NULL);
+		CHECK_STR(got, (const char *)sqlite3_column_text(stmt, 0));
+	}
+	sqlite3_finalize(stmt);
+
+	snprintf(key, sizeof(key), "Output.%lld.CPlanet.Posts.%lld",
+	    (long long)v->rowid, (long long)n);
+	CHECK(hdf_get_obj(cp->dataset, key) == NULL);
+	CHECK_INT(v->count, n);
+}
+
+static void
+check_build(struct view *views)
+{
+	uint64_t h;
+	HDF *node;
+	int i, n = 0;
+
+	for (i = 0; i < NVIEWS; i++) {
+		views[i].count = 0;
+		views[i].hash = HASH_INIT;
+	}
+	CHECK_INT(dataset_build(views, NVIEWS, &h), 0);
+	for (i = 0; i < NVIEWS; i++)
+		check_view(&views[i]);
+
+	/* a post several outputs show is set once */
+	for (node = hdf_get_child(cp->dataset, "Posts"); node != NULL;
+	    node = hdf_obj_next(node))
+		n++;
+	CHECK(n <= 2 * NENTRIES);
+	for (i = 0; i < NVIEWS; i++)
+		CHECK(views[i].count <= n);
+}
+
+int
+main(void)
+{
+	struct view views[NVIEWS];
+	int i;
+
+	check_db();
+	check_config("max_post", "5");
+	store_feed("x");
+	store_feed("y");
+
+	memset(views, 0, sizeof(views));
+	views[0].filter.limit = 5;
+	views[1].filter.limit = 3;
+	views[1].filter.feed = "x";
+	views[2].filter.limit = 4;
+	views[2].filter.tag = "even";
+	views[3].filter.limit = 100;
+	views[3].filter.feed = "y";
+	views[3].filter.tag = "third";
+	views[4].filter.limit = 5;
+	views[4].filter.tag = "none";
+	views[5].filter.limit = 2;
+	views[5].filter.feed = "x";
+	for (i = 0; i < NVIEWS; i++)
+		views[i].rowid = i + 1;
+
+	/* the unfiltered output reads the recent window */
+	check_build(views);
+
+	/* past it, the whole archive, with the filtered ones again */
+	views[0].filter.limit = 2 * NENTRIES + 10;
+	views[1].filter.limit = NENTRIES;
+	check_build(views);
+
+	/* the filtered outputs alone */
+	views[0].filter.limit = 0;
+	check_build(views);
+
+	return (check_done());
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2010, Baptiste Daroussin
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* what the minify option of the outputs writes */
+
+#include "../core.c"
+#include "check.h"
+
+#define MINIFY_PATH "check_minify.html"
+
+/* in chunks of step bytes, as clearsilver hands the output in pieces */
+static char *
+minify(const char *in, size_t step)
+{
+	struct sink sink;
+	int64_t levels[SIBLING_MAX] = { 0 };
+	FILE *f;
+	char *out;
+	size_t len, n;
+	long size;
+
+	if (sink_open(&sink, MINIFY_PATH, levels, true) != 0)
+		err(1, "%s", MINIFY_PATH);
+	for (len = strlen(in); len > 0; in += n, len -= n) {
+		n = MIN(step, len);
+		if (sink_write(&sink, in, n) != 0)
+			err(1, "%s", MINIFY_PATH);
+	}
+	if (sink_commit(&sink, MINIFY_PATH, levels) != 0)
+		err(1, "%s", MINIFY_PATH);
+	sink_free(&sink);
+
+	if ((f = fopen(MINIFY_PATH, "r")) == NULL)
+		err(1, "%s", MINIFY_PATH);
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	rewind(f);
+	if ((out = calloc(1, size + 1)) == NULL ||
+	    fread(out, 1, size, f) != (size_t)size)
+		err(1, "%s", MINIFY_PATH);
+	fclose(f);
+	unlink(MINIFY_PATH);
+
+	return (out);
+}
+
+static void
+check_minify(const char *in, const char *want)
+{
+	char *out;
+	size_t step;
+
+	for (step = 1; step <= strlen(in); step = step * 3 + 1) {
+		out = minify(in, step);
+		if (strcmp(out, want) != 0) {
+			fprintf(stderr, "in chunks of %zu, \"%s\" gave \"%s\"\n",
+			    step, in, out);
+			check_failures++;
+		}
+		free(out);
+	}
+}
+
+int
+main(void)
+{
+	/* the whitespace is collapsed, the line breaks kept */
+	check_minify("<p>  a   b \n\n c\t</p>\n", "<p> a b\nc </p>\n");
+	check_minify("<!-- dropped --><p>a <!-- - -> -- --> b</p>", "<p>a b</p>");
+
+	/* the raw elements are kept as they are, whatever their case */
+	check_minify("<div>\n  <pre>  a\n\n  <b> b </b></pre>  </div>",
+	    "<div>\n<pre>  a\n\n  <b> b </b></pre> </div>");
+	check_minify("<PRE class=\"x\">  a  </Pre>  b",
+	    "<PRE class=\"x\">  a  </Pre> b");
+	check_minify("<textarea name=t>\n  a\n</textarea>",
+	    "<textarea name=t>\n  a\n</textarea>");
+	check_minify("<script>if (a  <  b) x();</script>",
+	    "<script>if (a  <  b) x();</script>");
+	check_minify("<prefix>  a</prefix>", "<prefix> a</prefix>");
+	check_minify("<![CDATA[  a  ]]>  b", "<![CDATA[  a  ]]> b");
+
+	/* the attributes values are quoted text */
+	check_minify("<a  href=\"x  y\"\n   title='a > b'  >t</a>",
+	    "<a href=\"x  y\" title='a > b'>t</a>");
+	check_minify("<img alt=\"<pre>\" src='a.png'>  <p>  x",
+	    "<img alt=\"<pre>\" src='a.png'> <p> x");
+
+	/* a bare < is text, the markup after it is still seen */
+	check_minify("1 < 2  and  <pre>  x  </pre>",
+	    "1 < 2 and <pre>  x  </pre>");
+	check_minify("a <= b, <3  <p>  c</p>", "a <= b, <3 <p> c</p>");
+	check_minify("x <", "x <");
+
+	return (check_done());
+}
@@ -40,6 +40,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define oom() exit(-1)
 
+/* the allocator can be replaced by defining these before the inclusion */
+#ifndef ut_malloc
+#define ut_malloc(sz) malloc(sz)
+#endif
+#ifndef ut_realloc
+#define ut_realloc(ptr,sz) realloc(ptr,sz)
+#endif
+#ifndef ut_free
+#define ut_free(ptr) free(ptr)
+#endif
+
 typedef void (ctor_f)(void *dst, const void *src);
 typedef void (dtor_f)(void *elt);
 typedef void (init_f)(void *elt);
@@ -69,25 +80,25 @@ typedef struct {
         (a)->icd.dtor(utarray_eltptr(a,_ut_i));                               \
       }                                                                       \
     }                                                                         \
-    free((a)->d);                                                             \
+    ut_free((a)->d);                                                          \
   }                                                                           \
   (a)->n=0;                                                                   \
 } while(0)
 
 #define utarray_new(a,_icd) do {                                              \
-  a=(UT_array*)malloc(sizeof(UT_array));                                      \
+  a=(UT_array*)ut_malloc(sizeof(UT_array));                                   \
   utarray_init(a,_icd);                                                       \
 } while(0)
 
 #define utarray_free(a) do {                                                  \
   utarray_done(a);                                                            \
-  free(a);                                                                    \
+  ut_free(a);                                                                 \
 } while(0)
 
 #define utarray_reserve(a,by) do {                                            \
   if (((a)->i+by) > ((a)->n)) {                                               \
     while(((a)->i+by) > ((a)->n)) { (a)->n = ((a)->n ? (2*(a)->n) : 8); }     \
-    if ( ((a)->d=(char*)realloc((a)->d, (a)->n*(a)->icd.sz)) == NULL) oom();  \
+    if ( ((a)->d=(char*)ut_realloc((a)->d, (a)->n*(a)->icd.sz)) == NULL) oom(); \
   }                                                                           \
 } while(0)
 
@@ -218,11 +229,15 @@ typedef struct {
 /* last we pre-define a few icd for common utarrays of ints and strings */
 static void utarray_str_cpy(void *dst, const void *src) {
   char **_src = (char**)src, **_dst = (char**)dst;
-  *_dst = (*_src == NULL) ? NULL : strdup(*_src);
+  size_t _len;
+  if (*_src == NULL) { *_dst = NULL; return; }
+  _len = strlen(*_src) + 1;
+  if ((*_dst = (char*)ut_malloc(_len)) == NULL) oom();
+  memcpy(*_dst, *_src, _len);
 }
 static void utarray_str_dtor(void *elt) {
   char **eltc = (char**)elt;
-  if (*eltc) free(*eltc);
+  if (*eltc) ut_free(*eltc);
 }
 static const UT_icd ut_str_icd _UNUSED_ = {sizeof(char*),NULL,utarray_str_cpy,utarray_str_dtor};
 static const UT_icd ut_int_icd _UNUSED_ = {sizeof(int),NULL,NULL,NULL};
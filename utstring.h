@@ -39,6 +39,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdarg.h>
 #define oom() exit(-1)
 
+/* the allocator can be replaced by defining these before the inclusion */
+#ifndef ut_malloc
+#define ut_malloc(sz) malloc(sz)
+#endif
+#ifndef ut_realloc
+#define ut_realloc(ptr,sz) realloc(ptr,sz)
+#endif
+#ifndef ut_free
+#define ut_free(ptr) free(ptr)
+#endif
+
 typedef struct {
     char *d;
     size_t n; /* allocd size */
@@ -48,7 +59,7 @@ typedef struct {
 #define utstring_reserve(s,amt)                            \
 do {                                                       \
   if (((s)->n - (s)->i) < (size_t)(amt)) {                 \
-     (s)->d = (char*)realloc((s)->d, (s)->n + amt);        \
+     (s)->d = (char*)ut_realloc((s)->d, (s)->n + amt);     \
      if ((s)->d == NULL) oom();                            \
      (s)->n += amt;                                        \
   }                                                        \
@@ -63,19 +74,19 @@ do {                                                       \
 
 #define utstring_done(s)                                   \
 do {                                                       \
-  if ((s)->d != NULL) free((s)->d);                        \
+  if ((s)->d != NULL) ut_free((s)->d);                     \
   (s)->n = 0;                                              \
 } while(0)
 
 #define utstring_free(s)                                   \
 do {                                                       \
   utstring_done(s);                                        \
-  free(s);                                                 \
+  ut_free(s);                                              \
 } while(0)
 
 #define utstring_new(s)                                    \
 do {                                                       \
-   s = (UT_string*)calloc(sizeof(UT_string),1);            \
+   s = (UT_string*)ut_malloc(sizeof(UT_string));           \
    if (!s) oom();                                          \
    utstring_init(s);                                       \
 } while(0)